@@ -21,15 +21,10 @@ typedef struct
     std::map<std::string, std::map<std::string, std::string>> sections;
     std::vector<std::string> comments;
     std::vector<std::string> errors;
-    std::string current_section;
 } ParserState;
 
 // Handler function prototype
-bool parsing_handler(ini_eventtype_t type,
-                     const char *section,
-                     const char *key,
-                     const char *value,
-                     void *userdata);
+bool parsing_handler(const ini_event_t *event, void *userdata);
 
 int main()
 {
@@ -44,9 +39,8 @@ int main()
         "[invalid_section\n"  // Missing closing bracket
         "key = value\n";
     ParserState state;
-    state.current_section = INI_LINE_SECTION;
     size_t length = strlen(ini_content);
-    bool success = ini_parse_stream(ini_content, length, parsing_handler, &state);
+    bool success = ini_parse_stream_spans(ini_content, length, parsing_handler, &state, NULL);
     // Display results
     std::cout << "Parsing " << (success ? "completed" : "aborted") << "\n\n";
     std::cout << "Comments (" << state.comments.size() << "):\n";
@@ -78,27 +72,22 @@ int main()
     return 0;
 }
 
-bool parsing_handler(ini_eventtype_t type,
-                     const char *section,
-                     const char *key,
-                     const char *value,
-                     void *userdata)
+// Spans point into the input, so strings are built straight from pointer and length
+bool parsing_handler(const ini_event_t *event, void *userdata)
 {
     ParserState *state = static_cast<ParserState *>(userdata);
+    std::string section(event->section.ptr, event->section.len);
+    std::string value(event->value.ptr ? event->value.ptr : "", event->value.len);
 
-    switch(type)
+    switch(event->type)
     {
         case INI_EVENT_SECTION:
-            state->current_section = section;
             state->sections[section]; // Create empty section
             break;
 
         case INI_EVENT_KEY_VALUE:
-        {
-            const char *actual_section = state->current_section.c_str();
-            state->sections[actual_section][key] = value;
+            state->sections[section][std::string(event->key.ptr, event->key.len)] = value;
             break;
-        }
 
         case INI_EVENT_COMMENT:
             state->comments.push_back(value);
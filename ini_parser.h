@@ -18,7 +18,7 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stddef.h>
-#include <ctype.h>
+#include <stdint.h>
 
 #ifndef INI_MAX_LINE_LENGTH
 #define INI_MAX_LINE_LENGTH 256
@@ -41,26 +41,132 @@ typedef enum
     INI_LINE_INVALID
 } ini_linetype_t;
 
+#ifndef INI_ARENA_BLOCK_SIZE
+#define INI_ARENA_BLOCK_SIZE 512
+#endif
+
+// Bytes indexed per stage-1 pass of INI_ENGINE_STRUCTURAL; offsets are stored in 16 bits
+#ifndef INI_STRUCTURAL_WINDOW
+#define INI_STRUCTURAL_WINDOW 65536
+#endif
+
+#if INI_STRUCTURAL_WINDOW > 65536
+#error "INI_STRUCTURAL_WINDOW must not exceed 65536"
+#endif
+
+// Bytes each thread tokenizes at a time when ini_options_t.threads asks for a parallel parse
+#ifndef INI_PARALLEL_CHUNK
+#define INI_PARALLEL_CHUNK (1 << 20)
+#endif
+
+typedef struct ini_arena_block_t
+{
+    struct ini_arena_block_t *next;
+    size_t size;
+    size_t used;
+} ini_arena_block_t;
+
 typedef struct ini_keyvalue_t
 {
-    char key[INI_MAX_LINE_LENGTH];
-    char value[INI_MAX_LINE_LENGTH];
-    struct ini_keyvalue_t *next;
+    const char *key;
+    const char *value;
+    uint32_t keyLength;
+    uint32_t valueLength;
 } ini_keyvalue_t;
 
 typedef struct ini_section_t
 {
-    char name[INI_MAX_LINE_LENGTH];
-    ini_keyvalue_t *keyValues;
-    struct ini_section_t *next;
+    const char *name;
+    uint32_t nameLength;
+    uint32_t hash;
+    uint32_t firstKey;
+    uint32_t keyCount;
 } ini_section_t;
 
+struct ini_lazy_t;
+
+// Sections and keys live in flat arrays in input order; section i owns keys
+// [firstKey, firstKey + keyCount). Key hashes sit in their own array so probing
+// and scanning touch only hashes until a candidate needs a string compare.
+// Lazy contexts (ini_options_t.lazy) append a section's keys when it is first looked up.
 typedef struct
 {
-    char *content;
     ini_section_t *sections;
+    size_t sectionCount;
+    ini_keyvalue_t *keyValues;
+    uint32_t *keyHashes;
+    size_t keyCount;
+    uint32_t *sectionIndex;
+    size_t sectionIndexSize;
+    uint32_t *keyIndex;
+    size_t keyIndexSize;
+    ini_arena_block_t *arena;
+    struct ini_lazy_t *lazy;
 } ini_context_t;
 
+typedef enum
+{
+    INI_DUPLICATE_LAST_WINS,
+    INI_DUPLICATE_FIRST_WINS,
+    INI_DUPLICATE_KEEP_ALL
+} ini_duplicate_t;
+
+typedef enum
+{
+    INI_ENGINE_LINEAR,
+    INI_ENGINE_STRUCTURAL
+} ini_engine_t;
+
+typedef struct
+{
+    ini_duplicate_t duplicateKeys;
+    bool keepDuplicateSections;
+    ini_engine_t engine;
+    unsigned threads;
+    bool lazy;
+    unsigned skipEvents;
+    // Streaming only: names of the sections whose events are delivered, or NULL for all
+    const char *const *sectionFilter;
+    size_t sectionFilterCount;
+} ini_options_t;
+
+// Resolved (section, key) pair; valid for the lifetime of the context it came from
+typedef struct
+{
+    uint32_t key;
+} ini_handle_t;
+
+typedef struct
+{
+    uint64_t hash;
+    uint32_t name;
+    uint32_t nameLength;
+} ini_frozen_section_t;
+
+typedef struct
+{
+    uint64_t hash;
+    uint32_t section;
+    uint32_t key;
+    uint32_t keyLength;
+    uint32_t value;
+    uint32_t valueLength;
+} ini_frozen_entry_t;
+
+typedef struct
+{
+    void *block;
+    const ini_frozen_section_t *sections;
+    const ini_frozen_entry_t *entries;
+    const uint32_t *sectionSeeds;
+    const uint32_t *entrySeeds;
+    const char *strings;
+    uint32_t sectionCount;
+    uint32_t sectionBucketCount;
+    uint32_t entryCount;
+    uint32_t entryBucketCount;
+} ini_frozen_t;
+
 typedef enum
 {
     INI_EVENT_SECTION,
@@ -69,514 +175,3796 @@ typedef enum
     INI_EVENT_ERROR
 } ini_eventtype_t;
 
+// Bit of ini_options_t.skipEvents that keeps events of type from being delivered
+#define INI_EVENT_MASK(type) (1u << (type))
+
 typedef bool (*ini_handler)(ini_eventtype_t type, const char *section, const char *key, const char *value, void *userdata);
 
+// Bytes of the input a token occupies; not NUL-terminated
+typedef struct
+{
+    const char *ptr;
+    size_t len;
+} ini_span_t;
+
+// One line reported as spans. section is the section the line belongs to (empty before the
+// first header) and sectionId its position among the headers, counting from 1 (0 before the
+// first header); comments and errors carry the whole line in value. line counts from 1.
+typedef struct
+{
+    ini_eventtype_t type;
+    ini_span_t section;
+    ini_span_t key;
+    ini_span_t value;
+    uint32_t sectionId;
+    size_t line;
+} ini_event_t;
+
+typedef bool (*ini_span_handler)(const ini_event_t *event, void *userdata);
+typedef bool (*ini_batch_handler)(const ini_event_t *events, size_t count, void *userdata);
+
+// Caller-owned state of a pull parse; it holds no resources and needs no cleanup
+typedef struct
+{
+    const char *ptr;
+    const char *end;
+    ini_span_t section;
+    uint32_t sectionId;
+    size_t line;
+} ini_reader_t;
+
+// State of an incremental parse fed by ini_push_feed. Only the start of a line that continues
+// in the next chunk is kept, so memory stays fixed however long the input is.
+typedef struct
+{
+    ini_handler handler;
+    void *userdata;
+    char section[INI_MAX_LINE_LENGTH];
+    char line[INI_MAX_LINE_LENGTH];
+    size_t lineLength;
+    bool stopped;
+} ini_push_t;
+
 bool ini_initialize(ini_context_t *ctx, const char *content, size_t length);
+bool ini_initialize_insitu(ini_context_t *ctx, char *buffer, size_t length);
+bool ini_initialize_ex(ini_context_t *ctx, const char *content, size_t length, const ini_options_t *options);
+bool ini_initialize_insitu_ex(ini_context_t *ctx, char *buffer, size_t length, const ini_options_t *options);
 void ini_cleanup(ini_context_t *ctx);
 bool ini_hasSection(const ini_context_t *ctx, const char *section);
 bool ini_hasKey(const ini_context_t *ctx, const char *section, const char *key);
 bool ini_hasValue(const ini_context_t *ctx, const char *section, const char *key);
 bool ini_getValue(const ini_context_t *ctx, const char *section, const char *key,
                   char *value, size_t maxLen);
+bool ini_getValueRef(const ini_context_t *ctx, const char *section, const char *key,
+                     const char **value, size_t *length);
+size_t ini_getValueCount(const ini_context_t *ctx, const char *section, const char *key);
+bool ini_getValueAt(const ini_context_t *ctx, const char *section, const char *key, size_t n,
+                    const char **value, size_t *length);
+bool ini_resolve(const ini_context_t *ctx, const char *section, const char *key, ini_handle_t *handle);
+bool ini_getValueByHandle(const ini_context_t *ctx, ini_handle_t handle, const char **value, size_t *length);
+bool ini_freeze(const ini_context_t *ctx, ini_frozen_t *frozen);
+void ini_frozen_cleanup(ini_frozen_t *frozen);
+bool ini_frozen_hasSection(const ini_frozen_t *frozen, const char *section);
+bool ini_frozen_hasKey(const ini_frozen_t *frozen, const char *section, const char *key);
+bool ini_frozen_getValue(const ini_frozen_t *frozen, const char *section, const char *key,
+                         char *value, size_t maxLen);
+bool ini_frozen_getValueRef(const ini_frozen_t *frozen, const char *section, const char *key,
+                            const char **value, size_t *length);
 bool ini_parse_stream(const char *content, size_t length, ini_handler handler, void *userdata);
+bool ini_parse_stream_ex(const char *content, size_t length, ini_handler handler, void *userdata,
+                         const ini_options_t *options);
+bool ini_parse_stream_spans(const char *content, size_t length, ini_span_handler handler, void *userdata,
+                            const ini_options_t *options);
+bool ini_parse_stream_batch(const char *content, size_t length, ini_event_t *events, size_t capacity,
+                            ini_batch_handler handler, void *userdata, const ini_options_t *options);
+bool ini_reader_init(ini_reader_t *reader, const char *content, size_t length);
+bool ini_reader_next(ini_reader_t *reader, ini_event_t *event);
+bool ini_push_init(ini_push_t *parser, ini_handler handler, void *userdata);
+bool ini_push_feed(ini_push_t *parser, const char *data, size_t length);
+bool ini_push_finish(ini_push_t *parser);
+bool ini_setKernel(const char *name);
+const char *ini_getKernel(void);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif /* INI_PARSER_H */
+#endif /* INI_PARSER_H */
+
+#ifdef INI_PARSER_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+// Every allocation goes through these; define all four to use another allocator
+#ifndef INI_MALLOC
+#define INI_MALLOC malloc
+#define INI_CALLOC calloc
+#define INI_REALLOC realloc
+#define INI_FREE free
+#endif
+
+#if !defined(INI_DISABLE_THREADS) && defined(_WIN32)
+#include <windows.h>
+#elif !defined(INI_DISABLE_THREADS)
+#include <pthread.h>
+#endif
+
+#if !defined(INI_DISABLE_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define INI_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define INI_TARGET(isa)
+#else
+#define INI_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif !defined(INI_DISABLE_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define INI_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+
+#if defined(_WIN64)
+static unsigned lowestBit64(uint64_t mask)
+{
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (unsigned)index;
+}
+
+static unsigned highestBit64(uint64_t mask)
+{
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return (unsigned)index;
+}
+#else
+// 32-bit targets only have the 32-bit scans, so each half is scanned on its own
+static unsigned lowestBit64(uint64_t mask)
+{
+    unsigned long index;
+
+    if(_BitScanForward(&index, (unsigned long)mask))
+    {
+        return (unsigned)index;
+    }
+
+    _BitScanForward(&index, (unsigned long)(mask >> 32));
+    return 32u + (unsigned)index;
+}
+
+static unsigned highestBit64(uint64_t mask)
+{
+    unsigned long index;
+
+    if(_BitScanReverse(&index, (unsigned long)(mask >> 32)))
+    {
+        return 32u + (unsigned)index;
+    }
+
+    _BitScanReverse(&index, (unsigned long)mask);
+    return (unsigned)index;
+}
+#endif
+#else
+static unsigned lowestBit64(uint64_t mask)
+{
+    return (unsigned)__builtin_ctzll(mask);
+}
+
+static unsigned highestBit64(uint64_t mask)
+{
+    return 63u - (unsigned)__builtin_clzll(mask);
+}
+#endif
+
+// Scanning kernels. Every ISA provides the same five operations, and the best one the
+// CPU supports is picked once at first use (see ini_setKernel):
+//   findAny2      first byte in [ptr, end) equal to a or b, or end
+//   skipSpace     first non-whitespace byte in [ptr, end), or end
+//   skipSpaceBack end of [start, end) once trailing whitespace is dropped
+//   equalFold     whether two equally long byte ranges match ignoring ASCII case
+//   structurals   offsets of every line end, ']', '=' and ':' in [ptr, ptr + len), in order;
+//                 out must hold len entries
+typedef struct
+{
+    const char *name;
+    const char *(*findAny2)(const char *ptr, const char *end, char a, char b);
+    const char *(*skipSpace)(const char *ptr, const char *end);
+    const char *(*skipSpaceBack)(const char *start, const char *end);
+    bool (*equalFold)(const char *a, const char *b, size_t len);
+    size_t (*structurals)(const char *ptr, size_t len, uint16_t *out);
+} ini_kernel_t;
+
+// Byte classes for the tokenizer. A fixed table keeps classification independent of the
+// host's locale and costs one load per byte.
+enum
+{
+    INI_CHAR_SPACE = 1 << 0,         // ' ', '\t', '\n', '\v', '\f', '\r'
+    INI_CHAR_NEWLINE = 1 << 1,       // '\n', '\r'
+    INI_CHAR_DELIMITER = 1 << 2,     // '=', ':'
+    INI_CHAR_COMMENT = 1 << 3,       // ';', '#'
+    INI_CHAR_SECTION_OPEN = 1 << 4,  // '['
+    INI_CHAR_SECTION_CLOSE = 1 << 5  // ']'
+};
+
+#define INI_SP INI_CHAR_SPACE
+#define INI_NL INI_CHAR_NEWLINE
+#define INI_DL INI_CHAR_DELIMITER
+#define INI_CM INI_CHAR_COMMENT
+#define INI_SO INI_CHAR_SECTION_OPEN
+#define INI_SC INI_CHAR_SECTION_CLOSE
+static const unsigned char charClass[256] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, INI_SP, INI_SP|INI_NL, INI_SP, INI_SP, INI_SP|INI_NL, 0, 0, // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+    INI_SP, 0, 0, INI_CM, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, INI_DL, INI_CM, 0, INI_DL, 0, 0, // 0x30
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x40
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, INI_SO, 0, INI_SC, 0, 0, // 0x50
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x60
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x70
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x80
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x90
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xA0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xB0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xC0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xD0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xE0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 // 0xF0
+};
+#undef INI_SP
+#undef INI_NL
+#undef INI_DL
+#undef INI_CM
+#undef INI_SO
+#undef INI_SC
+
+static bool hasClass(char c, unsigned char classes)
+{
+    return (charClass[(unsigned char)c] & classes) != 0;
+}
+
+static bool isSpaceByte(unsigned char c)
+{
+    return (charClass[c] & INI_CHAR_SPACE) != 0;
+}
+
+static unsigned char foldByte(unsigned char c)
+{
+    return (unsigned char)(c - 'A') <= 'Z' - 'A' ? c + ('a' - 'A') : c;
+}
+
+static const char *findAny2Scalar(const char *ptr, const char *end, char a, char b)
+{
+    while(ptr < end && *ptr != a && *ptr != b)
+    {
+        ptr++;
+    }
+
+    return ptr;
+}
+
+static const char *skipSpaceScalar(const char *ptr, const char *end)
+{
+    while(ptr < end && isSpaceByte((unsigned char)*ptr))
+    {
+        ptr++;
+    }
+
+    return ptr;
+}
+
+static const char *skipSpaceBackScalar(const char *start, const char *end)
+{
+    while(end > start && isSpaceByte((unsigned char)end[-1]))
+    {
+        end--;
+    }
+
+    return end;
+}
+
+static bool equalFoldScalar(const char *a, const char *b, size_t len)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        if(foldByte((unsigned char)a[i]) != foldByte((unsigned char)b[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Appends structurals of [ptr + i, ptr + len); vector kernels finish their tails with it
+static size_t structuralsFrom(const char *ptr, size_t i, size_t len, uint16_t *out, size_t count)
+{
+    // Branch-free: every offset is written, but only structural ones are kept
+    for(; i < len; i++)
+    {
+        out[count] = (uint16_t)i;
+        count += hasClass(ptr[i], INI_CHAR_NEWLINE | INI_CHAR_DELIMITER | INI_CHAR_SECTION_CLOSE);
+    }
+
+    return count;
+}
+
+static size_t structuralsScalar(const char *ptr, size_t len, uint16_t *out)
+{
+    return structuralsFrom(ptr, 0, len, out, 0);
+}
+
+static const ini_kernel_t kernelScalar =
+{
+    "scalar", findAny2Scalar, skipSpaceScalar, skipSpaceBackScalar, equalFoldScalar, structuralsScalar
+};
+
+// SWAR ("SIMD within a register") kernels work on 64-bit words with plain integer
+// arithmetic, so they run anywhere and are the default when no vector ISA is available.
+// Masks carry 0x80 in every selected byte and nothing else.
+#define INI_SWAR_ONES 0x0101010101010101ull
+#define INI_SWAR_HIGH 0x8080808080808080ull
+
+static uint64_t loadWord(const char *ptr)
+{
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    return word;
+}
+
+// Exact zero-byte mask; the cheaper (x - 1) & ~x form flags bytes after a zero falsely
+static uint64_t zeroBytes(uint64_t x)
+{
+    return ~(((x & ~INI_SWAR_HIGH) + ~INI_SWAR_HIGH) | x | ~INI_SWAR_HIGH);
+}
+
+// Bytes in [lo, hi], for hi < 0x80
+static uint64_t rangeBytes(uint64_t x, unsigned char lo, unsigned char hi)
+{
+    uint64_t low = x & ~INI_SWAR_HIGH;
+    uint64_t aboveLo = low + INI_SWAR_ONES * (0x80 - lo);
+    uint64_t aboveHi = low + INI_SWAR_ONES * (0x7f - hi);
+    return aboveLo & ~aboveHi & ~x & INI_SWAR_HIGH;
+}
+
+static uint64_t spaceBytes(uint64_t x)
+{
+    return zeroBytes(x ^ (INI_SWAR_ONES * ' ')) | rangeBytes(x, '\t', '\r');
+}
+
+// Offsets of the first and last selected byte in memory order
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static unsigned firstByte(uint64_t mask)
+{
+    return (63u - highestBit64(mask)) >> 3;
+}
+
+static unsigned lastByte(uint64_t mask)
+{
+    return (63u - lowestBit64(mask)) >> 3;
+}
+
+static uint64_t dropFirstByte(uint64_t mask)
+{
+    return mask & ~(1ull << highestBit64(mask));
+}
+
+// Moves every flag to the byte before it in memory
+static uint64_t fromNextByte(uint64_t mask)
+{
+    return mask << 8;
+}
+#else
+static unsigned firstByte(uint64_t mask)
+{
+    return lowestBit64(mask) >> 3;
+}
+
+static unsigned lastByte(uint64_t mask)
+{
+    return highestBit64(mask) >> 3;
+}
+
+static uint64_t dropFirstByte(uint64_t mask)
+{
+    return mask & (mask - 1);
+}
+
+static uint64_t fromNextByte(uint64_t mask)
+{
+    return mask >> 8;
+}
+#endif
+
+// Number of flagged bytes; the per-byte flags are summed into the top byte
+static size_t countBytes(uint64_t mask)
+{
+    return (size_t)(((mask >> 7) * INI_SWAR_ONES) >> 56);
+}
+
+static const char *findAny2Swar(const char *ptr, const char *end, char a, char b)
+{
+    const uint64_t wa = INI_SWAR_ONES * (unsigned char)a;
+    const uint64_t wb = INI_SWAR_ONES * (unsigned char)b;
+
+    while(end - ptr >= 8)
+    {
+        uint64_t word = loadWord(ptr);
+        uint64_t mask = zeroBytes(word ^ wa) | zeroBytes(word ^ wb);
+
+        if(mask)
+        {
+            return ptr + firstByte(mask);
+        }
+
+        ptr += 8;
+    }
+
+    return findAny2Scalar(ptr, end, a, b);
+}
+
+static const char *skipSpaceSwar(const char *ptr, const char *end)
+{
+    while(end - ptr >= 8)
+    {
+        uint64_t mask = ~spaceBytes(loadWord(ptr)) & INI_SWAR_HIGH;
+
+        if(mask)
+        {
+            return ptr + firstByte(mask);
+        }
+
+        ptr += 8;
+    }
+
+    return skipSpaceScalar(ptr, end);
+}
+
+static const char *skipSpaceBackSwar(const char *start, const char *end)
+{
+    while(end - start >= 8)
+    {
+        uint64_t mask = ~spaceBytes(loadWord(end - 8)) & INI_SWAR_HIGH;
+
+        if(mask)
+        {
+            return end - 7 + lastByte(mask);
+        }
+
+        end -= 8;
+    }
+
+    return skipSpaceBackScalar(start, end);
+}
+
+static uint64_t foldWord(uint64_t x)
+{
+    // 0x80 >> 2 is the 0x20 that separates upper from lower case
+    return x | (rangeBytes(x, 'A', 'Z') >> 2);
+}
+
+static bool equalFoldSwar(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+
+    for(; i + 8 <= len; i += 8)
+    {
+        uint64_t wa = loadWord(a + i);
+        uint64_t wb = loadWord(b + i);
+
+        if(wa != wb && foldWord(wa) != foldWord(wb))
+        {
+            return false;
+        }
+    }
+
+    return equalFoldScalar(a + i, b + i, len - i);
+}
+
+static size_t structuralsSwar(const char *ptr, size_t len, uint16_t *out)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    for(; i + 8 <= len; i += 8)
+    {
+        uint64_t word = loadWord(ptr + i);
+        uint64_t mask = zeroBytes(word ^ (INI_SWAR_ONES * '\n')) | zeroBytes(word ^ (INI_SWAR_ONES * '\r')) |
+                        zeroBytes(word ^ (INI_SWAR_ONES * ']')) | zeroBytes(word ^ (INI_SWAR_ONES * '=')) |
+                        zeroBytes(word ^ (INI_SWAR_ONES * ':'));
+
+        for(; mask; mask = dropFirstByte(mask))
+        {
+            out[count++] = (uint16_t)(i + firstByte(mask));
+        }
+    }
+
+    return structuralsFrom(ptr, i, len, out, count);
+}
+
+static const ini_kernel_t kernelSwar =
+{
+    "swar", findAny2Swar, skipSpaceSwar, skipSpaceBackSwar, equalFoldSwar, structuralsSwar
+};
+
+#if defined(INI_SIMD_X86)
+// Appends the offset of every set bit of a one-bit-per-byte mask, lowest first
+static size_t flattenMask(uint64_t mask, size_t base, uint16_t *out, size_t count)
+{
+    while(mask)
+    {
+        out[count++] = (uint16_t)(base + lowestBit64(mask));
+        mask &= mask - 1;
+    }
+
+    return count;
+}
+
+// Whitespace is ' ' or '\t'..'\r'; the range test is a wrapping subtract then a
+// saturating one that leaves zero only for bytes inside the range
+INI_TARGET("sse2") static __m128i spaceMaskSse2(__m128i chunk)
+{
+    __m128i range = _mm_subs_epu8(_mm_sub_epi8(chunk, _mm_set1_epi8('\t')), _mm_set1_epi8('\r' - '\t'));
+    return _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                        _mm_cmpeq_epi8(range, _mm_setzero_si128()));
+}
+
+INI_TARGET("sse2") static __m128i foldSse2(__m128i chunk)
+{
+    __m128i range = _mm_subs_epu8(_mm_sub_epi8(chunk, _mm_set1_epi8('A')), _mm_set1_epi8('Z' - 'A'));
+    __m128i upper = _mm_cmpeq_epi8(range, _mm_setzero_si128());
+    return _mm_add_epi8(chunk, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+INI_TARGET("sse2") static const char *findAny2Sse2(const char *ptr, const char *end, char a, char b)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+
+    while(end - ptr >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)ptr);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+                            _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+
+        if(mask)
+        {
+            return ptr + lowestBit64(mask);
+        }
+
+        ptr += 16;
+    }
+
+    return findAny2Scalar(ptr, end, a, b);
+}
+
+INI_TARGET("sse2") static const char *skipSpaceSse2(const char *ptr, const char *end)
+{
+    while(end - ptr >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)ptr);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(spaceMaskSse2(chunk)) ^ 0xffffu;
+
+        if(mask)
+        {
+            return ptr + lowestBit64(mask);
+        }
+
+        ptr += 16;
+    }
+
+    return skipSpaceScalar(ptr, end);
+}
+
+INI_TARGET("sse2") static const char *skipSpaceBackSse2(const char *start, const char *end)
+{
+    while(end - start >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(end - 16));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(spaceMaskSse2(chunk)) ^ 0xffffu;
+
+        if(mask)
+        {
+            return end - 15 + highestBit64(mask);
+        }
+
+        end -= 16;
+    }
+
+    return skipSpaceBackScalar(start, end);
+}
+
+INI_TARGET("sse2") static bool equalFoldSse2(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i va = foldSse2(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m128i vb = foldSse2(_mm_loadu_si128((const __m128i *)(b + i)));
+
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff)
+        {
+            return false;
+        }
+    }
+
+    return equalFoldScalar(a + i, b + i, len - i);
+}
+
+INI_TARGET("sse2") static uint32_t structuralMaskSse2(const char *ptr)
+{
+    __m128i chunk = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+                                _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']')));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('=')));
+    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')));
+    return (uint32_t)_mm_movemask_epi8(hits);
+}
+
+INI_TARGET("sse2") static size_t structuralsSse2(const char *ptr, size_t len, uint16_t *out)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    for(; i + 16 <= len; i += 16)
+    {
+        count = flattenMask(structuralMaskSse2(ptr + i), i, out, count);
+    }
+
+    return structuralsFrom(ptr, i, len, out, count);
+}
+
+static const ini_kernel_t kernelSse2 =
+{
+    "sse2", findAny2Sse2, skipSpaceSse2, skipSpaceBackSse2, equalFoldSse2, structuralsSse2
+};
+
+INI_TARGET("avx2") static __m256i spaceMaskAvx2(__m256i chunk)
+{
+    __m256i range = _mm256_subs_epu8(_mm256_sub_epi8(chunk, _mm256_set1_epi8('\t')),
+                                     _mm256_set1_epi8('\r' - '\t'));
+    return _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                           _mm256_cmpeq_epi8(range, _mm256_setzero_si256()));
+}
+
+INI_TARGET("avx2") static __m256i foldAvx2(__m256i chunk)
+{
+    __m256i range = _mm256_subs_epu8(_mm256_sub_epi8(chunk, _mm256_set1_epi8('A')),
+                                     _mm256_set1_epi8('Z' - 'A'));
+    __m256i upper = _mm256_cmpeq_epi8(range, _mm256_setzero_si256());
+    return _mm256_add_epi8(chunk, _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+INI_TARGET("avx2") static const char *findAny2Avx2(const char *ptr, const char *end, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+
+    while(end - ptr >= 64)
+    {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)ptr);
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(ptr + 32));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(
+                            _mm256_or_si256(_mm256_cmpeq_epi8(lo, va), _mm256_cmpeq_epi8(lo, vb)));
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(hi, va), _mm256_cmpeq_epi8(hi, vb))) << 32;
+
+        if(mask)
+        {
+            return ptr + lowestBit64(mask);
+        }
+
+        ptr += 64;
+    }
+
+    if(end - ptr >= 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)ptr);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)));
+
+        if(mask)
+        {
+            return ptr + lowestBit64(mask);
+        }
+
+        ptr += 32;
+    }
+
+    _mm256_zeroupper();
+    return findAny2Sse2(ptr, end, a, b);
+}
+
+INI_TARGET("avx2") static const char *skipSpaceAvx2(const char *ptr, const char *end)
+{
+    while(end - ptr >= 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)ptr);
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(spaceMaskAvx2(chunk));
+
+        if(mask)
+        {
+            return ptr + lowestBit64(mask);
+        }
+
+        ptr += 32;
+    }
+
+    _mm256_zeroupper();
+    return skipSpaceSse2(ptr, end);
+}
+
+INI_TARGET("avx2") static const char *skipSpaceBackAvx2(const char *start, const char *end)
+{
+    while(end - start >= 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(end - 32));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(spaceMaskAvx2(chunk));
+
+        if(mask)
+        {
+            return end - 31 + highestBit64(mask);
+        }
+
+        end -= 32;
+    }
+
+    _mm256_zeroupper();
+    return skipSpaceBackSse2(start, end);
+}
+
+INI_TARGET("avx2") static bool equalFoldAvx2(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i va = foldAvx2(_mm256_loadu_si256((const __m256i *)(a + i)));
+        __m256i vb = foldAvx2(_mm256_loadu_si256((const __m256i *)(b + i)));
+
+        if((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != 0xffffffffu)
+        {
+            return false;
+        }
+    }
+
+    _mm256_zeroupper();
+    return equalFoldSse2(a + i, b + i, len - i);
+}
+
+INI_TARGET("avx2") static uint32_t structuralMaskAvx2(const char *ptr)
+{
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)ptr);
+    __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')),
+                                   _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r')));
+    hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(']')));
+    hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('=')));
+    hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(':')));
+    return (uint32_t)_mm256_movemask_epi8(hits);
+}
+
+INI_TARGET("avx2") static size_t structuralsAvx2(const char *ptr, size_t len, uint16_t *out)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    for(; i + 64 <= len; i += 64)
+    {
+        uint64_t mask = structuralMaskAvx2(ptr + i) | (uint64_t)structuralMaskAvx2(ptr + i + 32) << 32;
+        count = flattenMask(mask, i, out, count);
+    }
+
+    if(i + 32 <= len)
+    {
+        count = flattenMask(structuralMaskAvx2(ptr + i), i, out, count);
+        i += 32;
+    }
+
+    _mm256_zeroupper();
+    return structuralsFrom(ptr, i, len, out, count);
+}
+
+static const ini_kernel_t kernelAvx2 =
+{
+    "avx2", findAny2Avx2, skipSpaceAvx2, skipSpaceBackAvx2, equalFoldAvx2, structuralsAvx2
+};
+
+#if defined(_MSC_VER) && !defined(__clang__)
+static bool cpuHasSse2(void)
+{
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] >> 26) & 1;
+}
+
+static bool cpuHasAvx2(void)
+{
+    int info[4];
+    __cpuid(info, 1);
+
+    // The OS must also save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+    if(!((info[2] >> 27) & 1) || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 5) & 1;
+}
+#else
+static bool cpuHasSse2(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+static bool cpuHasAvx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+#elif defined(INI_SIMD_NEON)
+// Narrowing shift packs the 16 byte lanes into 4 bits each of one 64-bit mask
+static uint64_t maskNeon(uint8x16_t hits)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+}
+
+static uint8x16_t spaceMaskNeon(uint8x16_t chunk)
+{
+    uint8x16_t range = vcleq_u8(vsubq_u8(chunk, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t'));
+    return vorrq_u8(vceqq_u8(chunk, vdupq_n_u8(' ')), range);
+}
+
+static uint8x16_t foldNeon(uint8x16_t chunk)
+{
+    uint8x16_t upper = vcleq_u8(vsubq_u8(chunk, vdupq_n_u8('A')), vdupq_n_u8('Z' - 'A'));
+    return vaddq_u8(chunk, vandq_u8(upper, vdupq_n_u8('a' - 'A')));
+}
+
+static const char *findAny2Neon(const char *ptr, const char *end, char a, char b)
+{
+    const uint8x16_t va = vdupq_n_u8((uint8_t)a);
+    const uint8x16_t vb = vdupq_n_u8((uint8_t)b);
+
+    while(end - ptr >= 16)
+    {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)ptr);
+        uint64_t mask = maskNeon(vorrq_u8(vceqq_u8(chunk, va), vceqq_u8(chunk, vb)));
+
+        if(mask)
+        {
+            return ptr + (lowestBit64(mask) >> 2);
+        }
+
+        ptr += 16;
+    }
+
+    return findAny2Scalar(ptr, end, a, b);
+}
+
+static const char *skipSpaceNeon(const char *ptr, const char *end)
+{
+    while(end - ptr >= 16)
+    {
+        uint64_t mask = ~maskNeon(spaceMaskNeon(vld1q_u8((const uint8_t *)ptr)));
+
+        if(mask)
+        {
+            return ptr + (lowestBit64(mask) >> 2);
+        }
+
+        ptr += 16;
+    }
+
+    return skipSpaceScalar(ptr, end);
+}
+
+static const char *skipSpaceBackNeon(const char *start, const char *end)
+{
+    while(end - start >= 16)
+    {
+        uint64_t mask = ~maskNeon(spaceMaskNeon(vld1q_u8((const uint8_t *)(end - 16))));
+
+        if(mask)
+        {
+            return end - 15 + (highestBit64(mask) >> 2);
+        }
+
+        end -= 16;
+    }
+
+    return skipSpaceBackScalar(start, end);
+}
+
+static bool equalFoldNeon(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+
+    for(; i + 16 <= len; i += 16)
+    {
+        uint8x16_t va = foldNeon(vld1q_u8((const uint8_t *)(a + i)));
+        uint8x16_t vb = foldNeon(vld1q_u8((const uint8_t *)(b + i)));
+
+        if(~maskNeon(vceqq_u8(va, vb)))
+        {
+            return false;
+        }
+    }
+
+    return equalFoldScalar(a + i, b + i, len - i);
+}
+
+static size_t structuralsNeon(const char *ptr, size_t len, uint16_t *out)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    for(; i + 16 <= len; i += 16)
+    {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)(ptr + i));
+        uint8x16_t hits = vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('\n')), vceqq_u8(chunk, vdupq_n_u8('\r')));
+        hits = vorrq_u8(hits, vceqq_u8(chunk, vdupq_n_u8(']')));
+        hits = vorrq_u8(hits, vceqq_u8(chunk, vdupq_n_u8('=')));
+        hits = vorrq_u8(hits, vceqq_u8(chunk, vdupq_n_u8(':')));
+        // Keep one of the four mask bits per lane
+        uint64_t mask = maskNeon(hits) & 0x8888888888888888ull;
+
+        for(; mask; mask &= mask - 1)
+        {
+            out[count++] = (uint16_t)(i + (lowestBit64(mask) >> 2));
+        }
+    }
+
+    return structuralsFrom(ptr, i, len, out, count);
+}
+
+static const ini_kernel_t kernelNeon =
+{
+    "neon", findAny2Neon, skipSpaceNeon, skipSpaceBackNeon, equalFoldNeon, structuralsNeon
+};
+#endif
+
+static bool kernelSupported(const ini_kernel_t *kernel)
+{
+#if defined(INI_SIMD_X86)
+
+    if(kernel == &kernelAvx2)
+    {
+        return cpuHasAvx2();
+    }
+
+    if(kernel == &kernelSse2)
+    {
+        return cpuHasSse2();
+    }
+
+#endif
+    return kernel != NULL;
+}
+
+// Best first; the first supported entry is the default
+static const ini_kernel_t *const kernels[] =
+{
+#if defined(INI_SIMD_X86)
+    &kernelAvx2,
+    &kernelSse2,
+#elif defined(INI_SIMD_NEON)
+    &kernelNeon,
+#endif
+    &kernelSwar,
+    &kernelScalar
+};
+
+static const ini_kernel_t *findKernel(const char *name)
+{
+    for(size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+        if((!name || strcmp(kernels[i]->name, name) == 0) && kernelSupported(kernels[i]))
+        {
+            return kernels[i];
+        }
+    }
+
+    return NULL;
+}
+
+// The automatic choice (which reads INI_PARSER_KERNEL) is made exactly once, by whichever
+// thread first needs a kernel. The override is written only by ini_setKernel, which must not
+// run while any other thread parses or looks up; everything else only reads it. Without a
+// thread backend (INI_DISABLE_THREADS) the first use is not synchronized, so it must not race.
+// Where C11 atomics exist, an acquire load lets every later use skip the once call.
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#define INI_ATOMIC_KERNEL
+#include <stdatomic.h>
+static _Atomic(const ini_kernel_t *) automaticKernel;
+#define loadAutomaticKernel() atomic_load_explicit(&automaticKernel, memory_order_acquire)
+#define storeAutomaticKernel(kernel) atomic_store_explicit(&automaticKernel, (kernel), memory_order_release)
+#else
+static const ini_kernel_t *automaticKernel;
+#define loadAutomaticKernel() (automaticKernel)
+#define storeAutomaticKernel(kernel) (automaticKernel = (kernel))
+#endif
+static const ini_kernel_t *overrideKernel;
+
+static void selectAutomaticKernel(void)
+{
+    const ini_kernel_t *kernel = findKernel(getenv("INI_PARSER_KERNEL"));
+    storeAutomaticKernel(kernel ? kernel : findKernel(NULL));
+}
+
+#if !defined(INI_DISABLE_THREADS) && defined(_WIN32)
+static INIT_ONCE kernelOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK kernelOnceEntry(PINIT_ONCE once, PVOID parameter, PVOID *context)
+{
+    (void)once;
+    (void)parameter;
+    (void)context;
+    selectAutomaticKernel();
+    return TRUE;
+}
+#elif !defined(INI_DISABLE_THREADS)
+static pthread_once_t kernelOnce = PTHREAD_ONCE_INIT;
+#endif
+
+static const ini_kernel_t *activeKernel(void)
+{
+    const ini_kernel_t *kernel = overrideKernel;
+
+    if(kernel)
+    {
+        return kernel;
+    }
+
+#ifdef INI_ATOMIC_KERNEL
+    kernel = loadAutomaticKernel();
+
+    if(kernel)
+    {
+        return kernel;
+    }
+
+#endif
+#if !defined(INI_DISABLE_THREADS) && defined(_WIN32)
+    InitOnceExecuteOnce(&kernelOnce, kernelOnceEntry, NULL, NULL);
+#elif !defined(INI_DISABLE_THREADS)
+    pthread_once(&kernelOnce, selectAutomaticKernel);
+#else
+
+    if(!loadAutomaticKernel())
+    {
+        selectAutomaticKernel();
+    }
+
+#endif
+    return loadAutomaticKernel();
+}
+
+#define findAny2(ptr, end, a, b) (activeKernel()->findAny2((ptr), (end), (a), (b)))
+
+// NULL restores automatic selection; fails if the kernel is unknown or unsupported here
+bool ini_setKernel(const char *name)
+{
+    if(!name)
+    {
+        overrideKernel = NULL;
+        return true;
+    }
+
+    const ini_kernel_t *kernel = findKernel(name);
+
+    if(!kernel)
+    {
+        return false;
+    }
+
+    overrideKernel = kernel;
+    return true;
+}
+
+const char *ini_getKernel(void)
+{
+    return activeKernel()->name;
+}
+
+// Copied strings live in a chain of arena blocks owned by the context. Blocks never
+// move, so pointers handed out stay valid until ini_cleanup.
+#define INI_ARENA_ALIGN sizeof(void *)
+
+static void *arenaAlloc(ini_context_t *ctx, size_t size)
+{
+    size = (size + INI_ARENA_ALIGN - 1) & ~(INI_ARENA_ALIGN - 1);
+    ini_arena_block_t *block = ctx->arena;
+
+    if(!block || block->size - block->used < size)
+    {
+        size_t blockSize = block ? block->size * 2 : INI_ARENA_BLOCK_SIZE;
+
+        while(blockSize < size)
+        {
+            blockSize *= 2;
+        }
+
+        ini_arena_block_t *newBlock = INI_MALLOC(sizeof(ini_arena_block_t) + blockSize);
+
+        if(!newBlock)
+        {
+            return NULL;
+        }
+
+        newBlock->next = block;
+        newBlock->size = blockSize;
+        newBlock->used = 0;
+        ctx->arena = newBlock;
+        block = newBlock;
+    }
+
+    void *ptr = (char *)(block + 1) + block->used;
+    block->used += size;
+    return ptr;
+}
+
+static const char *arenaString(ini_context_t *ctx, const char *str, size_t len)
+{
+    char *ptr = arenaAlloc(ctx, len + 1);
+
+    if(!ptr)
+    {
+        return NULL;
+    }
+
+    memcpy(ptr, str, len);
+    ptr[len] = '\0';
+    return ptr;
+}
+
+// Hashes are folded the same way namesEqual compares, so equal names always land in the same slot
+static uint32_t hashBytes(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for(size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)str[i];
+#ifndef INI_ENABLE_CASE_SENSITIVITY
+        c = foldByte(c);
+#endif
+        hash ^= c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t hashString(const char *str, size_t *len)
+{
+    *len = strlen(str);
+    return hashBytes(str, *len);
+}
+
+// Names carry their lengths, so a mismatch in length is rejected before any byte is read
+static bool namesEqual(const char *a, size_t alen, const char *b, size_t blen)
+{
+#ifdef INI_ENABLE_CASE_SENSITIVITY
+    return alen == blen && memcmp(a, b, alen) == 0;
+#else
+    return alen == blen && activeKernel()->equalFold(a, b, alen);
+#endif
+}
+
+static size_t indexSizeFor(size_t count)
+{
+    size_t size = 8;
+
+    while(size < count * 2)
+    {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+// Called for every occupied slot stepped over while building an index; the tests count them
+// to check that building stays linear
+#ifndef INI_COUNT_PROBE
+#define INI_COUNT_PROBE() ((void)0)
+#endif
+
+// Keys of all sections share one table; the section number is mixed into the start slot
+static size_t keySlot(size_t section, uint32_t hash, size_t mask)
+{
+    return (hash ^ ((uint32_t)section * 0x9e3779b9u)) & mask;
+}
+
+// Index entries hold an array position plus one, so a zeroed table is empty. Repeated
+// headers resolve to their first section, which is reported through canonical if given.
+static bool indexSections(ini_context_t *ctx, uint32_t *canonical)
+{
+    INI_FREE(ctx->sectionIndex);
+    ctx->sectionIndexSize = indexSizeFor(ctx->sectionCount);
+    ctx->sectionIndex = INI_CALLOC(ctx->sectionIndexSize, sizeof(uint32_t));
+
+    if(!ctx->sectionIndex)
+    {
+        return false;
+    }
+
+    size_t mask = ctx->sectionIndexSize - 1;
+
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        const ini_section_t *section = &ctx->sections[s];
+        size_t slot = section->hash & mask;
+
+        while(ctx->sectionIndex[slot])
+        {
+            const ini_section_t *other = &ctx->sections[ctx->sectionIndex[slot] - 1];
+
+            if(other->hash == section->hash &&
+                    namesEqual(other->name, other->nameLength, section->name, section->nameLength))
+            {
+                break;
+            }
+
+            INI_COUNT_PROBE();
+            slot = (slot + 1) & mask;
+        }
+
+        if(!ctx->sectionIndex[slot])
+        {
+            ctx->sectionIndex[slot] = (uint32_t)s + 1;
+        }
+
+        if(canonical)
+        {
+            canonical[s] = ctx->sectionIndex[slot] - 1;
+        }
+    }
+
+    return true;
+}
+
+// Folds every repeated section into its first occurrence and reindexes. Keys are regrouped
+// with a stable counting sort, so a merged section still owns one contiguous range.
+static bool mergeSections(ini_context_t *ctx, const uint32_t *canonical)
+{
+    size_t merged = 0;
+
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        merged += canonical[s] == s;
+    }
+
+    if(merged == ctx->sectionCount)
+    {
+        return true;
+    }
+
+    uint32_t *target = INI_MALLOC(ctx->sectionCount * sizeof(uint32_t));
+    uint32_t *cursor = INI_CALLOC(merged, sizeof(uint32_t));
+    ini_keyvalue_t *keyValues = INI_MALLOC((ctx->keyCount ? ctx->keyCount : 1) * sizeof(ini_keyvalue_t));
+    uint32_t *keyHashes = INI_MALLOC((ctx->keyCount ? ctx->keyCount : 1) * sizeof(uint32_t));
+
+    if(!target || !cursor || !keyValues || !keyHashes)
+    {
+        INI_FREE(target);
+        INI_FREE(cursor);
+        INI_FREE(keyValues);
+        INI_FREE(keyHashes);
+        return false;
+    }
+
+    for(size_t s = 0, t = 0; s < ctx->sectionCount; s++)
+    {
+        if(canonical[s] == s)
+        {
+            target[s] = (uint32_t)t++;
+        }
+
+        cursor[target[canonical[s]]] += ctx->sections[s].keyCount;
+    }
+
+    for(size_t t = 0, start = 0; t < merged; t++)
+    {
+        uint32_t count = cursor[t];
+        cursor[t] = (uint32_t)start;
+        start += count;
+    }
+
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        const ini_section_t *section = &ctx->sections[s];
+        uint32_t t = target[canonical[s]];
+
+        for(uint32_t k = section->firstKey; k < section->firstKey + section->keyCount; k++)
+        {
+            keyValues[cursor[t]] = ctx->keyValues[k];
+            keyHashes[cursor[t]++] = ctx->keyHashes[k];
+        }
+    }
+
+    // Sections only move towards the front, and cursor[t] now marks the end of range t
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        if(canonical[s] == s)
+        {
+            uint32_t t = target[s];
+            uint32_t first = t ? cursor[t - 1] : 0;
+            ctx->sections[t] = ctx->sections[s];
+            ctx->sections[t].firstKey = first;
+            ctx->sections[t].keyCount = cursor[t] - first;
+        }
+    }
+
+    INI_FREE(ctx->keyValues);
+    INI_FREE(ctx->keyHashes);
+    ctx->keyValues = keyValues;
+    ctx->keyHashes = keyHashes;
+    ctx->sectionCount = merged;
+    INI_FREE(target);
+    INI_FREE(cursor);
+    return indexSections(ctx, NULL);
+}
+
+// Duplicate keys are resolved here: unless all are kept, the shadowed records are compacted
+// away so every key in a section is unique and lookups can stop at the first match. The
+// survivors of section s are moved down to start at kept; returns the end of their range.
+static uint32_t indexSectionKeys(ini_context_t *ctx, size_t s, ini_duplicate_t duplicateKeys,
+                                 uint32_t kept)
+{
+    size_t keyMask = ctx->keyIndexSize - 1;
+    ini_section_t *section = &ctx->sections[s];
+    uint32_t first = kept;
+
+    for(uint32_t k = section->firstKey; k < section->firstKey + section->keyCount; k++)
+    {
+        size_t kslot = keySlot(s, ctx->keyHashes[k], keyMask);
+
+        while(ctx->keyIndex[kslot])
+        {
+            uint32_t other = ctx->keyIndex[kslot] - 1;
+
+            if(other >= first && other < kept && ctx->keyHashes[other] == ctx->keyHashes[k] &&
+                    namesEqual(ctx->keyValues[other].key, ctx->keyValues[other].keyLength,
+                               ctx->keyValues[k].key, ctx->keyValues[k].keyLength))
+            {
+                break;
+            }
+
+            INI_COUNT_PROBE();
+            kslot = (kslot + 1) & keyMask;
+        }
+
+        if(ctx->keyIndex[kslot] && duplicateKeys != INI_DUPLICATE_KEEP_ALL)
+        {
+            if(duplicateKeys == INI_DUPLICATE_LAST_WINS)
+            {
+                ini_keyvalue_t *original = &ctx->keyValues[ctx->keyIndex[kslot] - 1];
+                original->value = ctx->keyValues[k].value;
+                original->valueLength = ctx->keyValues[k].valueLength;
+            }
+
+            continue;
+        }
+
+        ctx->keyValues[kept] = ctx->keyValues[k];
+        ctx->keyHashes[kept] = ctx->keyHashes[k];
+        // Kept duplicates overwrite the slot so lookups see the last one
+        ctx->keyIndex[kslot] = ++kept;
+    }
+
+    section->firstKey = first;
+    section->keyCount = kept - first;
+    return kept;
+}
+
+static bool indexKeys(ini_context_t *ctx, ini_duplicate_t duplicateKeys)
+{
+    ctx->keyIndexSize = indexSizeFor(ctx->keyCount);
+    ctx->keyIndex = INI_CALLOC(ctx->keyIndexSize, sizeof(uint32_t));
+
+    if(!ctx->keyIndex)
+    {
+        return false;
+    }
+
+    uint32_t kept = 0;
+
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        kept = indexSectionKeys(ctx, s, duplicateKeys, kept);
+    }
+
+    ctx->keyCount = kept;
+    return true;
+}
+
+static const ini_section_t *findSection(const ini_context_t *ctx, const char *name)
+{
+    if(!ctx->sectionIndex)
+    {
+        return NULL;
+    }
+
+    size_t len;
+    uint32_t hash = hashString(name, &len);
+    size_t mask = ctx->sectionIndexSize - 1;
+
+    for(size_t slot = hash & mask; ctx->sectionIndex[slot]; slot = (slot + 1) & mask)
+    {
+        const ini_section_t *section = &ctx->sections[ctx->sectionIndex[slot] - 1];
+
+        if(section->hash == hash && namesEqual(section->name, section->nameLength, name, len))
+        {
+            return section;
+        }
+    }
+
+    return NULL;
+}
+
+static const ini_keyvalue_t *findKey(const ini_context_t *ctx, const ini_section_t *section,
+                                     const char *key)
+{
+    size_t len;
+    uint32_t hash = hashString(key, &len);
+    size_t mask = ctx->keyIndexSize - 1;
+
+    for(size_t slot = keySlot(section - ctx->sections, hash, mask); ctx->keyIndex[slot];
+            slot = (slot + 1) & mask)
+    {
+        uint32_t k = ctx->keyIndex[slot] - 1;
+
+        if(ctx->keyHashes[k] == hash && k - section->firstKey < section->keyCount &&
+                namesEqual(ctx->keyValues[k].key, ctx->keyValues[k].keyLength, key, len))
+        {
+            return &ctx->keyValues[k];
+        }
+    }
+
+    return NULL;
+}
+
+typedef struct
+{
+    ini_linetype_t type;
+    const char *start;
+    const char *end;
+    ini_span_t section;
+    ini_span_t key;
+    ini_span_t value;
+    size_t number;
+} ini_line_t;
+
+// Most tokens are not padded at all, so the kernels are only called past a leading space
+static const char *skipSpace(const char *ptr, const char *end)
+{
+    return ptr < end && isSpaceByte((unsigned char)*ptr) ? activeKernel()->skipSpace(ptr + 1, end) : ptr;
+}
+
+static const char *skipSpaceBack(const char *start, const char *end)
+{
+    return end > start && isSpaceByte((unsigned char)end[-1]) ?
+           activeKernel()->skipSpaceBack(start, end - 1) : end;
+}
+
+static ini_span_t trimSpan(const char *start, const char *end)
+{
+    start = skipSpace(start, end);
+    end = skipSpaceBack(start, end);
+    ini_span_t span = { start, (size_t)(end - start) };
+    return span;
+}
+
+// Classifies [line, end) in one forward pass. Tokens come back as trimmed spans of the input;
+// nothing is copied, so callers decide whether and where a token needs terminating.
+// close and delimiter are the line's first ']' and first '=' or ':' (end if it has none) when
+// the caller already knows them, or NULL to have them searched for here.
+static ini_linetype_t scanLine(const char *line, const char *end, const char *close,
+                               const char *delimiter, ini_line_t *out)
+{
+    line = skipSpace(line, end);
+
+    if(line == end)
+    {
+        return INI_LINE_EMPTY;
+    }
+
+    if(hasClass(*line, INI_CHAR_COMMENT))
+    {
+        return INI_LINE_COMMENT;
+    }
+
+    if(hasClass(*line, INI_CHAR_SECTION_OPEN))
+    {
+        const char *start = ++line;
+
+        line = close ? close : findAny2(line, end, ']', ']');
+
+        if(line == end)
+        {
+            return INI_LINE_INVALID;
+        }
+
+        out->section = trimSpan(start, line);
+        return out->section.len ? INI_LINE_SECTION : INI_LINE_INVALID;
+    }
+
+    const char *keyStart = line;
+
+    line = delimiter ? delimiter : findAny2(line, end, '=', ':');
+
+    if(line == end)
+    {
+        return INI_LINE_INVALID;
+    }
+
+    out->key = trimSpan(keyStart, line);
+
+    if(out->key.len == 0)
+    {
+        return INI_LINE_INVALID;
+    }
+
+    out->value = trimSpan(line + 1, end);
+#ifndef INI_ALLOW_EMPTY_VALUES
+
+    if(out->value.len == 0)
+    {
+        return INI_LINE_INVALID;
+    }
+
+#endif
+    return INI_LINE_KEY_VALUE;
+}
+
+// Hands out the non-empty lines of a buffer one at a time, using the engine chosen at init
+typedef struct
+{
+    const char *ptr;
+    const char *end;
+    ini_engine_t engine;
+    size_t line;
+    // Structural engine only: offsets of the structurals of [window, windowEnd)
+    uint16_t *index;
+    size_t indexCount;
+    size_t indexPos;
+    const char *window;
+    const char *windowEnd;
+} ini_lexer_t;
+
+static bool lexerInit(ini_lexer_t *lexer, const char *content, size_t length, ini_engine_t engine)
+{
+    memset(lexer, 0, sizeof(ini_lexer_t));
+    lexer->ptr = content;
+    lexer->end = content + length;
+    lexer->engine = engine;
+    lexer->line = 1;
+
+    if(engine == INI_ENGINE_STRUCTURAL)
+    {
+        size_t window = length < INI_STRUCTURAL_WINDOW ? length : INI_STRUCTURAL_WINDOW;
+        lexer->index = INI_MALLOC((window ? window : 1) * sizeof(uint16_t));
+        return lexer->index != NULL;
+    }
+
+    return true;
+}
+
+static void lexerFree(ini_lexer_t *lexer)
+{
+    INI_FREE(lexer->index);
+    lexer->index = NULL;
+}
+
+static const char *capLine(const char *start, const char *end)
+{
+    return end - start > INI_MAX_LINE_LENGTH - 1 ? start + INI_MAX_LINE_LENGTH - 1 : end;
+}
+
+// Line numbers count "\r\n", a lone '\r' and a lone '\n' as one line break each
+static size_t lineBreak(const char *at, const char *end)
+{
+    return *at == '\n' || at + 1 == end || at[1] != '\n';
+}
+
+static bool nextLineLinear(ini_lexer_t *lexer, ini_line_t *line)
+{
+    while(lexer->ptr < lexer->end)
+    {
+        const char *start = lexer->ptr;
+        const char *lineEnd = findAny2(start, lexer->end, '\n', '\r');
+        line->number = lexer->line;
+
+        // Step past the line ending before any in-situ terminator can overwrite it
+        for(lexer->ptr = lineEnd; lexer->ptr < lexer->end && hasClass(*lexer->ptr, INI_CHAR_NEWLINE);)
+        {
+            lexer->line += lineBreak(lexer->ptr++, lexer->end);
+        }
+
+        line->start = start;
+        line->end = capLine(start, lineEnd);
+        line->type = scanLine(start, line->end, NULL, NULL, line);
+
+        if(line->type != INI_LINE_EMPTY)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void indexWindow(ini_lexer_t *lexer)
+{
+    size_t len = (size_t)(lexer->end - lexer->ptr);
+    lexer->window = lexer->ptr;
+    lexer->windowEnd = lexer->ptr + (len < INI_STRUCTURAL_WINDOW ? len : INI_STRUCTURAL_WINDOW);
+    lexer->indexCount = activeKernel()->structurals(lexer->window, (size_t)(lexer->windowEnd - lexer->window),
+                        lexer->index);
+    lexer->indexPos = 0;
+}
+
+// Stage 2 of the structural engine: lines and their delimiters are read off the index built
+// by stage 1 (indexWindow), so the text itself is only touched to trim and classify tokens.
+// Windows always start at a line start; a line cut by the window end is indexed again as
+// the start of the next window.
+static bool nextLineStructural(ini_lexer_t *lexer, ini_line_t *line)
+{
+    while(lexer->ptr < lexer->end)
+    {
+        if(lexer->ptr >= lexer->windowEnd)
+        {
+            indexWindow(lexer);
+        }
+
+        const char *start = lexer->ptr;
+        const char *lineEnd = NULL;
+        const char *close = NULL;
+        const char *delimiter = NULL;
+        bool indexed = true;
+        size_t i = lexer->indexPos;
+
+        for(; i < lexer->indexCount; i++)
+        {
+            const char *at = lexer->window + lexer->index[i];
+
+            if(hasClass(*at, INI_CHAR_NEWLINE))
+            {
+                lineEnd = at;
+                break;
+            }
+
+            if(*at == ']')
+            {
+                close = close ? close : at;
+            }
+            else
+            {
+                delimiter = delimiter ? delimiter : at;
+            }
+        }
+
+        line->number = lexer->line;
+
+        if(lineEnd)
+        {
+            lexer->indexPos = i + 1;
+            lexer->ptr = lineEnd + 1;
+            lexer->line += lineBreak(lineEnd, lexer->end);
+        }
+        else if(lexer->windowEnd == lexer->end)
+        {
+            lexer->indexPos = i;
+            lexer->ptr = lineEnd = lexer->end;
+        }
+        else if(start != lexer->window)
+        {
+            lexer->windowEnd = start;
+            continue;
+        }
+        else
+        {
+            // A line longer than a whole window is finished by the byte loop
+            lineEnd = findAny2(lexer->windowEnd, lexer->end, '\n', '\r');
+            lexer->ptr = lineEnd < lexer->end ? lineEnd + 1 : lineEnd;
+            lexer->line += lineEnd < lexer->end ? lineBreak(lineEnd, lexer->end) : 0;
+            lexer->windowEnd = lexer->ptr;
+            indexed = false;
+        }
+
+        line->start = start;
+        line->end = capLine(start, lineEnd);
+
+        if(indexed)
+        {
+            close = close && close < line->end ? close : line->end;
+            delimiter = delimiter && delimiter < line->end ? delimiter : line->end;
+        }
+        else
+        {
+            close = delimiter = NULL;
+        }
+
+        line->type = scanLine(start, line->end, close, delimiter, line);
+
+        if(line->type != INI_LINE_EMPTY)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool lexerNext(ini_lexer_t *lexer, ini_line_t *line)
+{
+    return lexer->engine == INI_ENGINE_STRUCTURAL ? nextLineStructural(lexer, line) :
+           nextLineLinear(lexer, line);
+}
+
+// Start of the first line in [ptr, end) whose first non-blank byte is '[', or end; ptr must
+// be a line start or a line break. '[' is searched for directly, so the lines in between are
+// passed over at kernel speed and only the candidates found are checked for starting a line.
+static const char *findHeaderLine(const char *ptr, const char *end)
+{
+    for(const char *at = ptr; (at = findAny2(at, end, '[', '[')) < end; at++)
+    {
+        const char *lineStart = at;
+
+        while(lineStart > ptr && hasClass(lineStart[-1], INI_CHAR_SPACE) &&
+                !hasClass(lineStart[-1], INI_CHAR_NEWLINE))
+        {
+            lineStart--;
+        }
+
+        if(lineStart == ptr || hasClass(lineStart[-1], INI_CHAR_NEWLINE))
+        {
+            return lineStart;
+        }
+    }
+
+    return end;
+}
+
+// Line breaks in [ptr, end), counted by the rules of lineBreak a word at a time
+static size_t countLineBreaks(const char *ptr, const char *end)
+{
+    size_t breaks = 0;
+
+    for(; end - ptr >= 8; ptr += 8)
+    {
+        uint64_t word = loadWord(ptr);
+        uint64_t lf = zeroBytes(word ^ (INI_SWAR_ONES * '\n'));
+        uint64_t cr = zeroBytes(word ^ (INI_SWAR_ONES * '\r'));
+        // "\r\n" is counted once, by its '\n', including a pair split between two words
+        breaks += countBytes(lf) + countBytes(cr & ~fromNextByte(lf));
+        breaks -= ptr[7] == '\r' && end - ptr > 8 && ptr[8] == '\n';
+    }
+
+    for(; ptr < end; ptr++)
+    {
+        breaks += hasClass(*ptr, INI_CHAR_NEWLINE) ? lineBreak(ptr, end) : 0;
+    }
+
+    return breaks;
+}
+
+// Moves the lexer on to the next line starting with '[' without tokenizing the lines in
+// between. Counting their line breaks is a separate pass, so it is only done when asked.
+static void lexerSkip(ini_lexer_t *lexer, bool countLines)
+{
+    const char *to = findHeaderLine(lexer->ptr, lexer->end);
+
+    if(countLines)
+    {
+        lexer->line += countLineBreaks(lexer->ptr, to);
+    }
+
+    lexer->ptr = to;
+
+    // The structural index of the current window stays valid past the skipped lines
+    while(to < lexer->windowEnd && lexer->indexPos < lexer->indexCount &&
+            lexer->window + lexer->index[lexer->indexPos] < to)
+    {
+        lexer->indexPos++;
+    }
+}
+
+// In-situ tokens are terminated by overwriting the byte that follows them. A token that
+// ends exactly at the end of the buffer has no such byte and is copied into the arena.
+static const char *storeSpan(ini_context_t *ctx, ini_span_t span, char *buffer, const char *end)
+{
+    if(buffer && span.ptr + span.len < end)
+    {
+        char *str = buffer + (span.ptr - buffer);
+        str[span.len] = '\0';
+        return str;
+    }
+
+    return arenaString(ctx, span.ptr, span.len);
+}
+
+static bool growArray(void **array, size_t *capacity, size_t elementSize)
+{
+    size_t newCapacity = *capacity ? *capacity * 2 : 16;
+
+    if(newCapacity > UINT32_MAX / 2)
+    {
+        return false;
+    }
+
+    void *grown = INI_REALLOC(*array, newCapacity * elementSize);
+
+    if(!grown)
+    {
+        return false;
+    }
+
+    *array = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+static const ini_options_t defaultOptions = {0};
+
+static ini_section_t *appendSection(ini_context_t *ctx, size_t *capacity)
+{
+    if(ctx->sectionCount == *capacity &&
+            !growArray((void **)&ctx->sections, capacity, sizeof(ini_section_t)))
+    {
+        return NULL;
+    }
+
+    ini_section_t *section = &ctx->sections[ctx->sectionCount++];
+    section->firstKey = (uint32_t)ctx->keyCount;
+    section->keyCount = 0;
+    return section;
+}
+
+// Appends the key/value pair of line to the key arrays; the caller credits it to a section
+static bool appendKey(ini_context_t *ctx, const ini_line_t *line, char *buffer, const char *end,
+                      size_t *capacity)
+{
+    if(ctx->keyCount == *capacity)
+    {
+        // The capacity only moves once both arrays have grown, so a lazy load that fails
+        // between the two can be retried
+        size_t valueCapacity = *capacity;
+        size_t hashCapacity = *capacity;
+
+        if(!growArray((void **)&ctx->keyValues, &valueCapacity, sizeof(ini_keyvalue_t)) ||
+                !growArray((void **)&ctx->keyHashes, &hashCapacity, sizeof(uint32_t)))
+        {
+            return false;
+        }
+
+        *capacity = valueCapacity;
+    }
+
+    ini_keyvalue_t *newKv = &ctx->keyValues[ctx->keyCount];
+
+    if(!(newKv->key = storeSpan(ctx, line->key, buffer, end)) ||
+            !(newKv->value = storeSpan(ctx, line->value, buffer, end)))
+    {
+        return false;
+    }
+
+    newKv->keyLength = (uint32_t)line->key.len;
+    newKv->valueLength = (uint32_t)line->value.len;
+    ctx->keyHashes[ctx->keyCount++] = hashBytes(line->key.ptr, line->key.len);
+    return true;
+}
+
+// Appends the sections and keys of [content, content + length) to ctx; end is the end of the
+// whole input. With inherit set, keys before the first header go to a leading section without
+// a name, which mergeFragments hands to the section the previous chunk ended in.
+static bool scanFragment(ini_context_t *ctx, const char *content, size_t length, char *buffer,
+                         const char *end, ini_engine_t engine, bool inherit)
+{
+    // Appends go to the end of amortized-doubling arrays, keeping the build linear
+    size_t sectionCapacity = 0;
+    size_t keyCapacity = 0;
+    ini_lexer_t lexer;
+    ini_line_t line;
+    bool ok = lexerInit(&lexer, content, length, engine);
+
+    while(ok && lexerNext(&lexer, &line))
+    {
+        if(line.type == INI_LINE_SECTION)
+        {
+            ini_section_t *newSection = appendSection(ctx, &sectionCapacity);
+
+            if(!newSection || !(newSection->name = storeSpan(ctx, line.section, buffer, end)))
+            {
+                ok = false;
+                break;
+            }
+
+            newSection->nameLength = (uint32_t)line.section.len;
+            newSection->hash = hashBytes(line.section.ptr, line.section.len);
+        }
+        else if(line.type == INI_LINE_KEY_VALUE && (ctx->sectionCount > 0 || inherit))
+        {
+            if(ctx->sectionCount == 0)
+            {
+                ini_section_t *inherited = appendSection(ctx, &sectionCapacity);
+
+                if(!inherited)
+                {
+                    ok = false;
+                    break;
+                }
+
+                inherited->name = NULL;
+                inherited->nameLength = 0;
+                inherited->hash = 0;
+            }
+
+            if(!appendKey(ctx, &line, buffer, end, &keyCapacity))
+            {
+                ok = false;
+                break;
+            }
+
+            ctx->sections[ctx->sectionCount - 1].keyCount++;
+        }
+    }
+
+    lexerFree(&lexer);
+    return ok;
+}
+
+#if !defined(INI_DISABLE_THREADS) && defined(_WIN32)
+typedef HANDLE ini_thread_t;
+#elif !defined(INI_DISABLE_THREADS)
+typedef pthread_t ini_thread_t;
+#endif
+
+typedef struct
+{
+    void (*run)(void *task);
+    void *task;
+#if !defined(INI_DISABLE_THREADS)
+    ini_thread_t thread;
+    bool started;
+#endif
+} ini_job_t;
+
+#if !defined(INI_DISABLE_THREADS) && defined(_WIN32)
+static DWORD WINAPI jobEntry(LPVOID arg)
+{
+    ini_job_t *job = (ini_job_t *)arg;
+    job->run(job->task);
+    return 0;
+}
+#elif !defined(INI_DISABLE_THREADS)
+static void *jobEntry(void *arg)
+{
+    ini_job_t *job = (ini_job_t *)arg;
+    job->run(job->task);
+    return NULL;
+}
+#endif
+
+// Runs run() on each of count tasks, all but the first on threads of their own. A task whose
+// thread cannot be started runs on the caller instead, so this cannot fail.
+static void runTasks(void (*run)(void *task), void *tasks, size_t taskSize, size_t count)
+{
+#if !defined(INI_DISABLE_THREADS)
+    ini_job_t *jobs = INI_CALLOC(count, sizeof(ini_job_t));
+
+    if(jobs)
+    {
+        for(size_t i = 1; i < count; i++)
+        {
+            jobs[i].run = run;
+            jobs[i].task = (char *)tasks + i * taskSize;
+#if defined(_WIN32)
+            jobs[i].thread = CreateThread(NULL, 0, jobEntry, &jobs[i], 0, NULL);
+            jobs[i].started = jobs[i].thread != NULL;
+#else
+            jobs[i].started = pthread_create(&jobs[i].thread, NULL, jobEntry, &jobs[i]) == 0;
+#endif
+        }
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(!jobs || !jobs[i].started)
+        {
+            run((char *)tasks + i * taskSize);
+        }
+    }
+
+    for(size_t i = 1; jobs && i < count; i++)
+    {
+        if(jobs[i].started)
+        {
+#if defined(_WIN32)
+            WaitForSingleObject(jobs[i].thread, INFINITE);
+            CloseHandle(jobs[i].thread);
+#else
+            pthread_join(jobs[i].thread, NULL);
+#endif
+        }
+    }
+
+    INI_FREE(jobs);
+#else
+
+    for(size_t i = 0; i < count; i++)
+    {
+        run((char *)tasks + i * taskSize);
+    }
+
+#endif
+}
+
+// Cuts [start, end) into count chunks that begin at line starts, so every line lies in exactly
+// one chunk. starts receives count + 1 boundaries; chunks may come out empty.
+static void splitChunks(const char *start, const char *end, size_t count, const char **starts)
+{
+    starts[0] = start;
+
+    for(size_t i = 1; i < count; i++)
+    {
+        const char *cut = start + (size_t)(end - start) / count * i;
+        cut = cut > starts[i - 1] ? cut : starts[i - 1];
+        cut = findAny2(cut, end, '\n', '\r');
+
+        while(cut < end && hasClass(*cut, INI_CHAR_NEWLINE))
+        {
+            cut++;
+        }
+
+        starts[i] = cut;
+    }
+
+    starts[count] = end;
+}
+
+static size_t chunkCount(size_t length, unsigned threads)
+{
+    size_t chunks = (length + INI_PARALLEL_CHUNK - 1) / INI_PARALLEL_CHUNK;
+    return chunks < threads ? (chunks ? chunks : 1) : threads;
+}
+
+typedef struct
+{
+    ini_context_t fragment;
+    const char *start;
+    size_t length;
+    char *buffer;
+    const char *end;
+    ini_engine_t engine;
+    bool inherit;
+    bool ok;
+} ini_fragment_task_t;
+
+static void scanFragmentTask(void *task)
+{
+    ini_fragment_task_t *t = (ini_fragment_task_t *)task;
+    t->ok = scanFragment(&t->fragment, t->start, t->length, t->buffer, t->end, t->engine, t->inherit);
+}
+
+// Concatenates the fragments in chunk order. Keys a fragment holds in its unnamed leading
+// section continue the section the previous chunks ended in, or are dropped like any key
+// that precedes the first header. Arena blocks are handed over to ctx.
+static bool mergeFragments(ini_context_t *ctx, ini_fragment_task_t *tasks, size_t count)
+{
+    size_t sectionCount = 0;
+    size_t keyCount = 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        sectionCount += tasks[i].fragment.sectionCount;
+        keyCount += tasks[i].fragment.keyCount;
+    }
+
+    ctx->sections = INI_MALLOC((sectionCount ? sectionCount : 1) * sizeof(ini_section_t));
+    ctx->keyValues = INI_MALLOC((keyCount ? keyCount : 1) * sizeof(ini_keyvalue_t));
+    ctx->keyHashes = INI_MALLOC((keyCount ? keyCount : 1) * sizeof(uint32_t));
+
+    if(!ctx->sections || !ctx->keyValues || !ctx->keyHashes)
+    {
+        return false;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        ini_context_t *fragment = &tasks[i].fragment;
+
+        for(size_t s = 0; s < fragment->sectionCount; s++)
+        {
+            const ini_section_t *section = &fragment->sections[s];
+
+            if(section->name)
+            {
+                ctx->sections[ctx->sectionCount] = *section;
+                ctx->sections[ctx->sectionCount++].firstKey = (uint32_t)ctx->keyCount;
+            }
+            else if(ctx->sectionCount > 0)
+            {
+                ctx->sections[ctx->sectionCount - 1].keyCount += section->keyCount;
+            }
+            else
+            {
+                continue;
+            }
+
+            // A fragment without keys has no key arrays to copy from
+            if(section->keyCount)
+            {
+                memcpy(ctx->keyValues + ctx->keyCount, fragment->keyValues + section->firstKey,
+                       section->keyCount * sizeof(ini_keyvalue_t));
+                memcpy(ctx->keyHashes + ctx->keyCount, fragment->keyHashes + section->firstKey,
+                       section->keyCount * sizeof(uint32_t));
+                ctx->keyCount += section->keyCount;
+            }
+        }
+
+        if(fragment->arena)
+        {
+            ini_arena_block_t *last = fragment->arena;
+
+            while(last->next)
+            {
+                last = last->next;
+            }
+
+            last->next = ctx->arena;
+            ctx->arena = fragment->arena;
+            fragment->arena = NULL;
+        }
+    }
+
+    return true;
+}
+
+// Chunks are tokenized concurrently into fragments, which are then merged in order
+static bool scanParallel(ini_context_t *ctx, const char *content, size_t length, char *buffer,
+                         const ini_options_t *options)
+{
+    size_t count = chunkCount(length, options->threads);
+    const char **starts = INI_MALLOC((count + 1) * sizeof(const char *));
+    ini_fragment_task_t *tasks = INI_CALLOC(count, sizeof(ini_fragment_task_t));
+    bool ok = starts && tasks;
+
+    if(ok)
+    {
+        splitChunks(content, content + length, count, starts);
+
+        for(size_t i = 0; i < count; i++)
+        {
+            tasks[i].start = starts[i];
+            tasks[i].length = (size_t)(starts[i + 1] - starts[i]);
+            tasks[i].buffer = buffer;
+            tasks[i].end = content + length;
+            tasks[i].engine = options->engine;
+            tasks[i].inherit = i > 0;
+        }
+
+        runTasks(scanFragmentTask, tasks, sizeof(ini_fragment_task_t), count);
+
+        for(size_t i = 0; i < count; i++)
+        {
+            ok = ok && tasks[i].ok;
+        }
+
+        ok = ok && mergeFragments(ctx, tasks, count);
+    }
+
+    for(size_t i = 0; tasks && i < count; i++)
+    {
+        ini_cleanup(&tasks[i].fragment);
+    }
+
+    INI_FREE(starts);
+    INI_FREE(tasks);
+    return ok;
+}
+
+// A lazy context records, for every header, the block of lines up to the next header. Blocks
+// of a repeated section are chained so merged lookups still see all of them; pending[s] is
+// the first block of section s plus one, zero once its keys have been parsed, or
+// INI_LAZY_FAILED when an in-situ load failed after it had already terminated tokens in place.
+#define INI_LAZY_FAILED UINT32_MAX
+
+typedef struct
+{
+    const char *start;
+    const char *end;
+    uint32_t next;
+} ini_lazy_block_t;
+
+typedef struct ini_lazy_t
+{
+    ini_lazy_block_t *blocks;
+    uint32_t *pending;
+    char *buffer;
+    const char *end;
+    ini_engine_t engine;
+    ini_duplicate_t duplicateKeys;
+    size_t keyCapacity;
+} ini_lazy_t;
+
+// Only header lines are tokenized up front; findHeaderLine passes over section bodies
+static bool scanHeaders(ini_context_t *ctx, const char *content, const char *end, char *buffer)
+{
+    ini_lazy_t *lazy = ctx->lazy;
+    size_t sectionCapacity = 0;
+    size_t blockCapacity = 0;
+    const char *lineStart;
+
+    for(const char *ptr = content; (lineStart = findHeaderLine(ptr, end)) < end;)
+    {
+        const char *lineEnd = findAny2(lineStart, end, '\n', '\r');
+        ini_line_t line;
+
+        if(scanLine(lineStart, capLine(lineStart, lineEnd), NULL, NULL, &line) == INI_LINE_SECTION)
+        {
+            if(ctx->sectionCount == blockCapacity &&
+                    !growArray((void **)&lazy->blocks, &blockCapacity, sizeof(ini_lazy_block_t)))
+            {
+                return false;
+            }
+
+            ini_section_t *section = appendSection(ctx, &sectionCapacity);
+
+            if(!section || !(section->name = storeSpan(ctx, line.section, buffer, end)))
+            {
+                return false;
+            }
+
+            section->nameLength = (uint32_t)line.section.len;
+            section->hash = hashBytes(line.section.ptr, line.section.len);
+
+            if(ctx->sectionCount > 1)
+            {
+                lazy->blocks[ctx->sectionCount - 2].end = lineStart;
+            }
+
+            ini_lazy_block_t *block = &lazy->blocks[ctx->sectionCount - 1];
+            block->start = lineEnd;
+            block->end = end;
+            block->next = 0;
+        }
+
+        ptr = lineEnd;
+    }
+
+    return true;
+}
+
+// The lazy counterpart of mergeSections: a repeated header appends its block to the chain of
+// the first section with that name instead of moving any keys
+static bool chainSections(ini_context_t *ctx, const uint32_t *canonical, bool keepDuplicates)
+{
+    ini_lazy_t *lazy = ctx->lazy;
+    uint32_t *target = INI_MALLOC(ctx->sectionCount * 2 * sizeof(uint32_t));
+    lazy->pending = INI_MALLOC(ctx->sectionCount * sizeof(uint32_t));
+
+    if(!target || !lazy->pending)
+    {
+        INI_FREE(target);
+        return false;
+    }
+
+    // tail[t] is the last block chained to section t so far
+    uint32_t *tail = target + ctx->sectionCount;
+    size_t merged = 0;
+
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        if(keepDuplicates || canonical[s] == s)
+        {
+            ctx->sections[merged] = ctx->sections[s];
+            lazy->pending[merged] = (uint32_t)s + 1;
+            tail[merged] = (uint32_t)s;
+            target[s] = (uint32_t)merged++;
+        }
+        else
+        {
+            uint32_t t = target[canonical[s]];
+            lazy->blocks[tail[t]].next = (uint32_t)s + 1;
+            tail[t] = (uint32_t)s;
+        }
+    }
+
+    INI_FREE(target);
+
+    if(merged == ctx->sectionCount)
+    {
+        return true;
+    }
+
+    ctx->sectionCount = merged;
+    return indexSections(ctx, NULL);
+}
+
+static bool buildLazy(ini_context_t *ctx, const char *content, size_t length, char *buffer,
+                      const ini_options_t *options)
+{
+    ctx->lazy = INI_CALLOC(1, sizeof(ini_lazy_t));
+    bool ok = ctx->lazy && scanHeaders(ctx, content, content + length, buffer) && ctx->sectionCount > 0;
+    uint32_t *canonical = ok ? INI_MALLOC(ctx->sectionCount * sizeof(uint32_t)) : NULL;
+    ok = canonical && indexSections(ctx, canonical) &&
+         chainSections(ctx, canonical, options->keepDuplicateSections);
+    INI_FREE(canonical);
+
+    if(!ok)
+    {
+        ini_cleanup(ctx);
+        return false;
+    }
+
+    ctx->lazy->buffer = buffer;
+    ctx->lazy->end = content + length;
+    ctx->lazy->engine = options->engine;
+    ctx->lazy->duplicateKeys = options->duplicateKeys;
+    return true;
+}
+
+// Keeps the shared key table at most half full as sections are loaded; growing it re-adds
+// the keys of every section loaded so far
+static bool growKeyIndex(ini_context_t *ctx)
+{
+    size_t size = indexSizeFor(ctx->keyCount);
+
+    if(size <= ctx->keyIndexSize)
+    {
+        return true;
+    }
+
+    uint32_t *keyIndex = INI_CALLOC(size, sizeof(uint32_t));
+
+    if(!keyIndex)
+    {
+        return false;
+    }
+
+    INI_FREE(ctx->keyIndex);
+    ctx->keyIndex = keyIndex;
+    ctx->keyIndexSize = size;
+
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        if(!ctx->lazy->pending[s])
+        {
+            indexSectionKeys(ctx, s, ctx->lazy->duplicateKeys, ctx->sections[s].firstKey);
+        }
+    }
+
+    return true;
+}
+
+// Parses the blocks of a pending section and appends its keys. Lookups take a const context
+// but are allowed to fill in a lazy one, which is only ever written through here.
+static bool loadSection(const ini_context_t *ctx, const ini_section_t *section)
+{
+    ini_lazy_t *lazy = ctx->lazy;
+    size_t s = (size_t)(section - ctx->sections);
+
+    if(!lazy || !lazy->pending[s])
+    {
+        return true;
+    }
+
+    if(lazy->pending[s] == INI_LAZY_FAILED)
+    {
+        return false;
+    }
+
+    ini_context_t *target = (ini_context_t *)ctx;
+    ini_section_t *current = &target->sections[s];
+    size_t first = target->keyCount;
+    bool ok = true;
+
+    for(uint32_t b = lazy->pending[s]; ok && b; b = lazy->blocks[b - 1].next)
+    {
+        const ini_lazy_block_t *block = &lazy->blocks[b - 1];
+        ini_lexer_t lexer;
+        ini_line_t line;
+        ok = lexerInit(&lexer, block->start, (size_t)(block->end - block->start), lazy->engine);
+
+        while(ok && lexerNext(&lexer, &line))
+        {
+            if(line.type == INI_LINE_KEY_VALUE)
+            {
+                ok = appendKey(target, &line, lazy->buffer, lazy->end, &lazy->keyCapacity);
+            }
+        }
+
+        lexerFree(&lexer);
+    }
+
+    current->firstKey = (uint32_t)first;
+    current->keyCount = (uint32_t)(target->keyCount - first);
+
+    if(!ok || !growKeyIndex(target))
+    {
+        // A copying load can simply be retried by the next lookup. An in-situ one has already
+        // cut up the lines it got through, which would re-lex into missing or truncated keys,
+        // so the section keeps failing instead.
+        target->keyCount = first;
+        current->keyCount = 0;
+        lazy->pending[s] = lazy->buffer ? INI_LAZY_FAILED : lazy->pending[s];
+        return false;
+    }
+
+    target->keyCount = indexSectionKeys(target, s, lazy->duplicateKeys, (uint32_t)first);
+    lazy->pending[s] = 0;
+    return true;
+}
+
+// Section lookup for everything that reads keys
+static const ini_section_t *findLoadedSection(const ini_context_t *ctx, const char *name)
+{
+    const ini_section_t *section = findSection(ctx, name);
+    return section && loadSection(ctx, section) ? section : NULL;
+}
+
+static bool buildContext(ini_context_t *ctx, const char *content, size_t length, char *buffer,
+                         const ini_options_t *options)
+{
+    // The input ends at its first NUL, so a length of sizeof("literal") takes just the text
+    const char *nul = content ? memchr(content, '\0', length) : NULL;
+    length = nul ? (size_t)(nul - content) : length;
+
+    if(!ctx || !content || length == 0)
+    {
+        return false;
+    }
+
+    if(!options)
+    {
+        options = &defaultOptions;
+    }
+
+    memset(ctx, 0, sizeof(ini_context_t));
+
+    if(options->lazy)
+    {
+        return buildLazy(ctx, content, length, buffer, options);
+    }
+
+    bool ok = options->threads > 1 ?
+              scanParallel(ctx, content, length, buffer, options) :
+              scanFragment(ctx, content, length, buffer, content + length, options->engine, false);
+
+    if(!ok || ctx->sectionCount == 0)
+    {
+        ini_cleanup(ctx);
+        return false;
+    }
+
+    uint32_t *canonical = INI_MALLOC(ctx->sectionCount * sizeof(uint32_t));
+    ok = canonical && indexSections(ctx, canonical);
+
+    if(ok && !options->keepDuplicateSections)
+    {
+        ok = mergeSections(ctx, canonical);
+    }
+
+    INI_FREE(canonical);
+
+    if(!ok || !indexKeys(ctx, options->duplicateKeys))
+    {
+        ini_cleanup(ctx);
+        return false;
+    }
+
+    return true;
+}
+
+bool ini_initialize(ini_context_t *ctx, const char *content, size_t length)
+{
+    return buildContext(ctx, content, length, NULL, NULL);
+}
+
+// Tokenizes the caller's buffer in place; it must outlive the context
+bool ini_initialize_insitu(ini_context_t *ctx, char *buffer, size_t length)
+{
+    return buildContext(ctx, buffer, length, buffer, NULL);
+}
+
+bool ini_initialize_ex(ini_context_t *ctx, const char *content, size_t length, const ini_options_t *options)
+{
+    return buildContext(ctx, content, length, NULL, options);
+}
+
+bool ini_initialize_insitu_ex(ini_context_t *ctx, char *buffer, size_t length, const ini_options_t *options)
+{
+    return buildContext(ctx, buffer, length, buffer, options);
+}
+
+void ini_cleanup(ini_context_t *ctx)
+{
+    if(!ctx)
+    {
+        return;
+    }
+
+    ini_arena_block_t *block = ctx->arena;
+
+    while(block)
+    {
+        ini_arena_block_t *next_block = block->next;
+        INI_FREE(block);
+        block = next_block;
+    }
+
+    INI_FREE(ctx->sections);
+    INI_FREE(ctx->keyValues);
+    INI_FREE(ctx->keyHashes);
+    INI_FREE(ctx->sectionIndex);
+    INI_FREE(ctx->keyIndex);
+
+    if(ctx->lazy)
+    {
+        INI_FREE(ctx->lazy->blocks);
+        INI_FREE(ctx->lazy->pending);
+        INI_FREE(ctx->lazy);
+    }
+
+    memset(ctx, 0, sizeof(ini_context_t));
+}
+
+bool ini_hasSection(const ini_context_t *ctx, const char *section)
+{
+    if(!ctx || !section)
+    {
+        return false;
+    }
+
+    return findSection(ctx, section) != NULL;
+}
+
+bool ini_hasKey(const ini_context_t *ctx, const char *section, const char *key)
+{
+    if(!ctx || !section || !key)
+    {
+        return false;
+    }
+
+    const ini_section_t *current = findLoadedSection(ctx, section);
+    return current && findKey(ctx, current, key);
+}
+
+bool ini_hasValue(const ini_context_t *ctx, const char *section, const char *key)
+{
+    size_t length;
+    return ini_getValueRef(ctx, section, key, NULL, &length) && length > 0;
+}
+
+bool ini_getValue(const ini_context_t *ctx, const char *section, const char *key,
+                  char *value, size_t maxLen)
+{
+    if(!value || maxLen == 0)
+    {
+        return false;
+    }
+
+    const char *ref;
+    size_t len;
+
+    if(!ini_getValueRef(ctx, section, key, &ref, &len))
+    {
+        return false;
+    }
+
+    len = len < maxLen - 1 ? len : maxLen - 1;
+    memcpy(value, ref, len);
+    value[len] = '\0';
+    return true;
+}
+
+// The returned pointer is NUL-terminated and stays valid until ini_cleanup
+bool ini_getValueRef(const ini_context_t *ctx, const char *section, const char *key,
+                     const char **value, size_t *length)
+{
+    if(!ctx || !section || !key)
+    {
+        return false;
+    }
+
+    const ini_section_t *current = findLoadedSection(ctx, section);
+    const ini_keyvalue_t *kv = current ? findKey(ctx, current, key) : NULL;
+
+    if(!kv)
+    {
+        return false;
+    }
+
+    if(value)
+    {
+        *value = kv->value;
+    }
+
+    if(length)
+    {
+        *length = kv->valueLength;
+    }
+
+    return true;
+}
+
+// Scans the section's hash array for every value of key, which only matters for
+// contexts built with INI_DUPLICATE_KEEP_ALL; otherwise keys are unique
+static size_t scanValues(const ini_context_t *ctx, const char *section, const char *key,
+                         size_t n, const ini_keyvalue_t **nth)
+{
+    const ini_section_t *current = findLoadedSection(ctx, section);
+    size_t found = 0;
+
+    if(!current)
+    {
+        return 0;
+    }
+
+    size_t len;
+    uint32_t hash = hashString(key, &len);
+
+    for(uint32_t k = current->firstKey; k < current->firstKey + current->keyCount; k++)
+    {
+        if(ctx->keyHashes[k] == hash &&
+                namesEqual(ctx->keyValues[k].key, ctx->keyValues[k].keyLength, key, len))
+        {
+            if(found++ == n)
+            {
+                *nth = &ctx->keyValues[k];
+            }
+        }
+    }
+
+    return found;
+}
+
+size_t ini_getValueCount(const ini_context_t *ctx, const char *section, const char *key)
+{
+    const ini_keyvalue_t *kv;
+    return (ctx && section && key) ? scanValues(ctx, section, key, 0, &kv) : 0;
+}
+
+bool ini_getValueAt(const ini_context_t *ctx, const char *section, const char *key, size_t n,
+                    const char **value, size_t *length)
+{
+    const ini_keyvalue_t *kv;
+
+    if(!ctx || !section || !key || scanValues(ctx, section, key, n, &kv) <= n)
+    {
+        return false;
+    }
+
+    if(value)
+    {
+        *value = kv->value;
+    }
+
+    if(length)
+    {
+        *length = kv->valueLength;
+    }
+
+    return true;
+}
+
+bool ini_resolve(const ini_context_t *ctx, const char *section, const char *key, ini_handle_t *handle)
+{
+    if(!ctx || !section || !key || !handle)
+    {
+        return false;
+    }
+
+    const ini_section_t *current = findLoadedSection(ctx, section);
+    const ini_keyvalue_t *kv = current ? findKey(ctx, current, key) : NULL;
+
+    if(!kv)
+    {
+        return false;
+    }
+
+    handle->key = (uint32_t)(kv - ctx->keyValues);
+    return true;
+}
+
+bool ini_getValueByHandle(const ini_context_t *ctx, ini_handle_t handle, const char **value, size_t *length)
+{
+    if(!ctx || handle.key >= ctx->keyCount)
+    {
+        return false;
+    }
+
+    const ini_keyvalue_t *kv = &ctx->keyValues[handle.key];
+
+    if(value)
+    {
+        *value = kv->value;
+    }
+
+    if(length)
+    {
+        *length = kv->valueLength;
+    }
+
+    return true;
+}
+
+static uint64_t hashFold64(uint64_t hash, const char *str)
+{
+    while(*str)
+    {
+        unsigned char c = (unsigned char)*str++;
+#ifndef INI_ENABLE_CASE_SENSITIVITY
+        c = foldByte(c);
+#endif
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static uint64_t hashSection64(const char *section)
+{
+    return hashFold64(14695981039346656037ull, section);
+}
+
+static uint64_t hashPair64(const char *section, const char *key)
+{
+    // The separator keeps ("ab", "c") and ("a", "bc") apart
+    uint64_t hash = (hashSection64(section) ^ 0xff) * 1099511628211ull;
+    return hashFold64(hash, key);
+}
+
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint32_t perfectBucket(uint64_t hash, uint32_t bucketCount)
+{
+    return (uint32_t)((mix64(hash) >> 32) % bucketCount);
+}
+
+// Seeds with this bit set name their bucket's slot directly instead of hashing to it
+#define INI_PERFECT_HASH_DIRECT 0x80000000u
+
+static uint32_t perfectSlot(uint64_t hash, uint32_t seed, uint32_t count)
+{
+    if(seed & INI_PERFECT_HASH_DIRECT)
+    {
+        return seed & ~INI_PERFECT_HASH_DIRECT;
+    }
+
+    return (uint32_t)(mix64(hash ^ (seed * 0x9e3779b97f4a7c15ull)) % count);
+}
+
+static int compareDescending(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x < y) - (x > y);
+}
+
+// Seeds a bucket of several items may try before ini_freeze gives up; only the tests lower it
+#ifndef INI_PERFECT_HASH_MAX_SEED
+#define INI_PERFECT_HASH_MAX_SEED (1u << 20)
+#endif
+
+// Hash-and-displace: items are grouped into buckets, and buckets (largest first) search
+// for a seed that sends all of their items to free slots. Every key then resolves with
+// exactly one probe: slot = perfectSlot(hash, seeds[perfectBucket(hash)]).
+// Buckets of one item come last, when the table is nearly full and a seed search could run
+// for about as many tries as there are slots; they take the next free slot directly instead,
+// so only items whose 64-bit hashes collide can make the build fail.
+static bool buildPerfectHash(const uint64_t *hashes, uint32_t count, uint32_t bucketCount,
+                             uint32_t *seeds, uint32_t *slotOf)
+{
+    if(count == 0)
+    {
+        memset(seeds, 0, bucketCount * sizeof(uint32_t));
+        return true;
+    }
+
+    uint32_t *bucketStart = INI_CALLOC(bucketCount + 1, sizeof(uint32_t));
+    uint32_t *items = INI_MALLOC(count * sizeof(uint32_t));
+    uint64_t *order = INI_MALLOC(bucketCount * sizeof(uint64_t));
+    uint32_t *slots = INI_MALLOC(count * sizeof(uint32_t));
+    bool *taken = INI_CALLOC(count, sizeof(bool));
+    bool ok = bucketStart && items && order && slots && taken;
+
+    if(ok)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            bucketStart[perfectBucket(hashes[i], bucketCount) + 1]++;
+        }
+
+        for(uint32_t b = 0; b < bucketCount; b++)
+        {
+            bucketStart[b + 1] += bucketStart[b];
+            order[b] = ((uint64_t)(bucketStart[b + 1] - bucketStart[b]) << 32) | b;
+        }
+
+        for(uint32_t i = 0; i < count; i++)
+        {
+            uint32_t b = perfectBucket(hashes[i], bucketCount);
+            items[--bucketStart[b + 1]] = i;
+        }
+
+        // Filling each bucket from its end left bucketStart[b + 1] at the start of bucket b
+        for(uint32_t b = 0; b < bucketCount; b++)
+        {
+            bucketStart[b] = bucketStart[b + 1];
+        }
+
+        bucketStart[bucketCount] = count;
+        qsort(order, bucketCount, sizeof(uint64_t), compareDescending);
+    }
+
+    uint32_t nextFree = 0;
+
+    for(uint32_t o = 0; ok && o < bucketCount; o++)
+    {
+        uint32_t b = (uint32_t)order[o];
+        uint32_t first = bucketStart[b];
+        uint32_t size = (uint32_t)(order[o] >> 32);
+        uint32_t seed = 0;
+
+        if(size == 1)
+        {
+            while(taken[nextFree])
+            {
+                nextFree++;
+            }
+
+            seeds[b] = nextFree | INI_PERFECT_HASH_DIRECT;
+            taken[nextFree] = true;
+            slotOf[items[first]] = nextFree;
+            continue;
+        }
+
+        for(; seed < INI_PERFECT_HASH_MAX_SEED; seed++)
+        {
+            uint32_t placed = 0;
+
+            while(placed < size)
+            {
+                uint32_t slot = perfectSlot(hashes[items[first + placed]], seed, count);
+                uint32_t j = 0;
+
+                while(j < placed && slots[j] != slot)
+                {
+                    j++;
+                }
+
+                if(taken[slot] || j < placed)
+                {
+                    break;
+                }
+
+                slots[placed++] = slot;
+            }
+
+            if(placed == size)
+            {
+                break;
+            }
+        }
+
+        if(seed == INI_PERFECT_HASH_MAX_SEED)
+        {
+            ok = false;
+            break;
+        }
+
+        seeds[b] = seed;
+
+        for(uint32_t j = 0; j < size; j++)
+        {
+            taken[slots[j]] = true;
+            slotOf[items[first + j]] = slots[j];
+        }
+    }
+
+    INI_FREE(bucketStart);
+    INI_FREE(items);
+    INI_FREE(order);
+    INI_FREE(slots);
+    INI_FREE(taken);
+    return ok;
+}
+
+static uint32_t poolString(char *strings, size_t *used, const char *str, size_t len)
+{
+    uint32_t offset = (uint32_t)*used;
+    memcpy(strings + offset, str, len + 1);
+    *used += len + 1;
+    return offset;
+}
+
+// A key is visible when lookups resolve to it rather than to one of its duplicates
+static bool isVisibleKey(const ini_context_t *ctx, const ini_section_t *section,
+                         const ini_keyvalue_t *kv)
+{
+    return findKey(ctx, section, kv->key) == kv;
+}
+
+// Snapshots what lookups on ctx can see into one immutable block that readers can share
+// without synchronization
+bool ini_freeze(const ini_context_t *ctx, ini_frozen_t *frozen)
+{
+    if(!ctx || !frozen || !ctx->sectionIndex)
+    {
+        return false;
+    }
+
+    // A frozen copy holds every section, so a lazy context is loaded in full first
+    for(size_t s = 0; s < ctx->sectionCount; s++)
+    {
+        if(!loadSection(ctx, &ctx->sections[s]))
+        {
+            return false;
+        }
+    }
+
+    memset(frozen, 0, sizeof(ini_frozen_t));
+    size_t sectionCount = 0;
+    size_t entryCount = 0;
+    size_t stringBytes = 0;
+
+    for(size_t i = 0; i < ctx->sectionIndexSize; i++)
+    {
+        if(!ctx->sectionIndex[i])
+        {
+            continue;
+        }
+
+        const ini_section_t *section = &ctx->sections[ctx->sectionIndex[i] - 1];
+        sectionCount++;
+        stringBytes += section->nameLength + 1;
+
+        for(uint32_t k = section->firstKey; k < section->firstKey + section->keyCount; k++)
+        {
+            const ini_keyvalue_t *kv = &ctx->keyValues[k];
+
+            if(isVisibleKey(ctx, section, kv))
+            {
+                entryCount++;
+                stringBytes += kv->keyLength + kv->valueLength + 2;
+            }
+        }
+    }
+
+    if(stringBytes > UINT32_MAX || sectionCount > UINT32_MAX / 2 || entryCount > UINT32_MAX / 2)
+    {
+        return false;
+    }
+
+    uint32_t sectionBuckets = (uint32_t)sectionCount / 2 + 1;
+    uint32_t entryBuckets = (uint32_t)entryCount / 2 + 1;
+    size_t size = sectionCount * sizeof(ini_frozen_section_t) +
+                  entryCount * sizeof(ini_frozen_entry_t) +
+                  (sectionBuckets + entryBuckets) * sizeof(uint32_t) + stringBytes;
+    char *block = INI_MALLOC(size);
+    uint64_t *hashes = INI_MALLOC((sectionCount + entryCount) * sizeof(uint64_t));
+    uint32_t *slotOf = INI_MALLOC((sectionCount + entryCount) * sizeof(uint32_t));
+    ini_frozen_section_t *sections = NULL;
+    ini_frozen_entry_t *entries = NULL;
+    uint32_t *entrySlot = NULL;
+    bool ok = block && hashes && slotOf;
+
+    if(ok)
+    {
+        sections = (ini_frozen_section_t *)block;
+        entries = (ini_frozen_entry_t *)(sections + sectionCount);
+        frozen->sectionSeeds = (const uint32_t *)(entries + entryCount);
+        frozen->entrySeeds = frozen->sectionSeeds + sectionBuckets;
+        frozen->strings = (const char *)(frozen->entrySeeds + entryBuckets);
+        entrySlot = slotOf + sectionCount;
+        size_t s = 0;
+
+        for(size_t i = 0; i < ctx->sectionIndexSize; i++)
+        {
+            if(ctx->sectionIndex[i])
+            {
+                hashes[s++] = hashSection64(ctx->sections[ctx->sectionIndex[i] - 1].name);
+            }
+        }
+
+        ok = buildPerfectHash(hashes, (uint32_t)sectionCount, sectionBuckets,
+                              (uint32_t *)frozen->sectionSeeds, slotOf);
+    }
+
+    if(ok)
+    {
+        char *strings = (char *)frozen->strings;
+        size_t used = 0;
+        size_t s = 0;
+        size_t e = 0;
+
+        for(size_t i = 0; i < ctx->sectionIndexSize; i++)
+        {
+            if(!ctx->sectionIndex[i])
+            {
+                continue;
+            }
+
+            const ini_section_t *section = &ctx->sections[ctx->sectionIndex[i] - 1];
+            uint32_t slot = slotOf[s];
+            sections[slot].hash = hashes[s++];
+            sections[slot].name = poolString(strings, &used, section->name, section->nameLength);
+            sections[slot].nameLength = section->nameLength;
+
+            for(uint32_t k = section->firstKey; k < section->firstKey + section->keyCount; k++)
+            {
+                const ini_keyvalue_t *kv = &ctx->keyValues[k];
+
+                if(!isVisibleKey(ctx, section, kv))
+                {
+                    continue;
+                }
+
+                // Entries are staged in input order and moved to their slots below
+                entries[e].hash = hashPair64(section->name, kv->key);
+                entries[e].section = slot;
+                entries[e].key = poolString(strings, &used, kv->key, kv->keyLength);
+                entries[e].keyLength = kv->keyLength;
+                entries[e].value = poolString(strings, &used, kv->value, kv->valueLength);
+                entries[e].valueLength = kv->valueLength;
+                hashes[sectionCount + e] = entries[e].hash;
+                e++;
+            }
+        }
+
+        ok = buildPerfectHash(hashes + sectionCount, (uint32_t)entryCount, entryBuckets,
+                              (uint32_t *)frozen->entrySeeds, entrySlot);
+    }
+
+    if(ok)
+    {
+        // Apply the permutation in place by following its cycles
+        for(uint32_t i = 0; i < entryCount; i++)
+        {
+            while(entrySlot[i] != i)
+            {
+                uint32_t target = entrySlot[i];
+                ini_frozen_entry_t tmp = entries[target];
+                entries[target] = entries[i];
+                entries[i] = tmp;
+                entrySlot[i] = entrySlot[target];
+                entrySlot[target] = target;
+            }
+        }
+    }
+
+    INI_FREE(hashes);
+    INI_FREE(slotOf);
+
+    if(!ok)
+    {
+        INI_FREE(block);
+        memset(frozen, 0, sizeof(ini_frozen_t));
+        return false;
+    }
+
+    frozen->block = block;
+    frozen->sections = sections;
+    frozen->entries = entries;
+    frozen->sectionCount = (uint32_t)sectionCount;
+    frozen->sectionBucketCount = sectionBuckets;
+    frozen->entryCount = (uint32_t)entryCount;
+    frozen->entryBucketCount = entryBuckets;
+    return true;
+}
+
+void ini_frozen_cleanup(ini_frozen_t *frozen)
+{
+    if(!frozen)
+    {
+        return;
+    }
+
+    INI_FREE(frozen->block);
+    memset(frozen, 0, sizeof(ini_frozen_t));
+}
+
+bool ini_frozen_hasSection(const ini_frozen_t *frozen, const char *section)
+{
+    if(!frozen || !section || frozen->sectionCount == 0)
+    {
+        return false;
+    }
+
+    uint64_t hash = hashSection64(section);
+    uint32_t seed = frozen->sectionSeeds[perfectBucket(hash, frozen->sectionBucketCount)];
+    const ini_frozen_section_t *entry = &frozen->sections[perfectSlot(hash, seed, frozen->sectionCount)];
+    return entry->hash == hash &&
+           namesEqual(frozen->strings + entry->name, entry->nameLength, section, strlen(section));
+}
+
+bool ini_frozen_hasKey(const ini_frozen_t *frozen, const char *section, const char *key)
+{
+    return ini_frozen_getValueRef(frozen, section, key, NULL, NULL);
+}
+
+bool ini_frozen_getValue(const ini_frozen_t *frozen, const char *section, const char *key,
+                         char *value, size_t maxLen)
+{
+    if(!value || maxLen == 0)
+    {
+        return false;
+    }
+
+    const char *ref;
+    size_t len;
 
-#ifdef INI_PARSER_IMPLEMENTATION
+    if(!ini_frozen_getValueRef(frozen, section, key, &ref, &len))
+    {
+        return false;
+    }
 
-#include <stdlib.h>
-#include <string.h>
+    len = len < maxLen - 1 ? len : maxLen - 1;
+    memcpy(value, ref, len);
+    value[len] = '\0';
+    return true;
+}
 
-static void trimWhitespace(char *str)
+bool ini_frozen_getValueRef(const ini_frozen_t *frozen, const char *section, const char *key,
+                            const char **value, size_t *length)
 {
-    if(!str || *str == '\0')
+    if(!frozen || !section || !key || frozen->entryCount == 0)
     {
-        return;
+        return false;
     }
 
-    char *start = str;
+    uint64_t hash = hashPair64(section, key);
+    uint32_t seed = frozen->entrySeeds[perfectBucket(hash, frozen->entryBucketCount)];
+    const ini_frozen_entry_t *entry = &frozen->entries[perfectSlot(hash, seed, frozen->entryCount)];
 
-    while(isspace((unsigned char)*start))
+    const ini_frozen_section_t *owner = &frozen->sections[entry->section];
+
+    if(entry->hash != hash ||
+            !namesEqual(frozen->strings + owner->name, owner->nameLength, section, strlen(section)) ||
+            !namesEqual(frozen->strings + entry->key, entry->keyLength, key, strlen(key)))
     {
-        start++;
+        return false;
     }
 
-    char *end = str + strlen(str) - 1;
-
-    while(end > start && isspace((unsigned char)*end))
+    if(value)
     {
-        end--;
+        *value = frozen->strings + entry->value;
     }
 
-    size_t len = (end >= start) ? (end - start + 1) : 0;
-
-    if(len > 0)
+    if(length)
     {
-        memmove(str, start, len);
+        *length = entry->valueLength;
     }
 
-    str[len] = '\0';
+    return true;
+}
+
+// Copies a span into dst and terminates it; returns the byte after the terminator
+static char *copySpan(char *dst, ini_span_t span)
+{
+    memcpy(dst, span.ptr, span.len);
+    dst[span.len] = '\0';
+    return dst + span.len + 1;
 }
 
-static ini_linetype_t parseLine(const char *line, char *section, char *key, char *value)
+// One tokenized line, kept until it can be reported in order
+typedef struct
+{
+    ini_linetype_t type;
+    ini_span_t first;  // section name, key, or the whole line of a comment or error
+    ini_span_t second; // value
+    size_t line;
+} ini_record_t;
+
+static void recordLine(const ini_line_t *line, ini_record_t *record)
 {
-    while(isspace((unsigned char)*line))
+    record->type = line->type;
+    record->line = line->number;
+
+    if(line->type == INI_LINE_SECTION)
     {
-        line++;
+        record->first = line->section;
     }
-
-    if(*line == '\0')
+    else if(line->type == INI_LINE_KEY_VALUE)
     {
-        return INI_LINE_EMPTY;
+        record->first = line->key;
+        record->second = line->value;
     }
-
-    if(*line == ';' || *line == '#')
+    else
     {
-        return INI_LINE_COMMENT;
+        record->first.ptr = line->start;
+        record->first.len = (size_t)(line->end - line->start);
     }
+}
 
-    if(*line == '[')
+// Handlers need terminated strings and the input is const, so each token is copied once.
+// Key and value are disjoint parts of one capped line, so both fit in one line-sized text buffer.
+static bool emitRecord(const ini_record_t *record, char *current_section, char *text,
+                       ini_handler handler, void *userdata)
+{
+    switch(record->type)
     {
-        const char *start = ++line;
+        case INI_LINE_SECTION:
+            copySpan(current_section, record->first);
+            return handler(INI_EVENT_SECTION, current_section, NULL, NULL, userdata);
 
-        while(*line && *line != ']' && *line != '\n')
+        case INI_LINE_KEY_VALUE:
         {
-            line++;
+            char *valueText = copySpan(text, record->first);
+            copySpan(valueText, record->second);
+            return handler(INI_EVENT_KEY_VALUE, current_section, text, valueText, userdata);
         }
 
-        if(*line == ']')
-        {
-            size_t len = line - start;
-            len = (len < INI_MAX_LINE_LENGTH - 1) ? len : INI_MAX_LINE_LENGTH - 1;
-            memcpy(section, start, len);
-            section[len] = '\0';
-            trimWhitespace(section);
+        case INI_LINE_COMMENT:
+        case INI_LINE_INVALID:
+            copySpan(text, record->first);
+            return handler(record->type == INI_LINE_COMMENT ? INI_EVENT_COMMENT : INI_EVENT_ERROR,
+                           NULL, NULL, text, userdata);
 
-            if(section[0] == '\0')
-            {
-                return INI_LINE_INVALID;
-            }
+        default:
+            return true;
+    }
+}
 
-            return INI_LINE_SECTION;
-        }
+// The span counterpart of emitRecord: tokens are described in place, and section and
+// sectionId track the current section
+static void recordEvent(const ini_record_t *record, ini_span_t *section, uint32_t *sectionId,
+                        ini_event_t *event)
+{
+    memset(event, 0, sizeof(ini_event_t));
 
-        return INI_LINE_INVALID;
-    }
-    else
+    switch(record->type)
     {
-        const char *keyStart = line;
-
-        while(*line && *line != '=' && *line != ':')
-        {
-            line++;
-        }
+        case INI_LINE_SECTION:
+            event->type = INI_EVENT_SECTION;
+            *section = record->first;
+            ++*sectionId;
+            break;
+
+        case INI_LINE_KEY_VALUE:
+            event->type = INI_EVENT_KEY_VALUE;
+            event->key = record->first;
+            event->value = record->second;
+            break;
+
+        default:
+            event->type = record->type == INI_LINE_COMMENT ? INI_EVENT_COMMENT : INI_EVENT_ERROR;
+            event->value = record->first;
+            break;
+    }
 
-        if(*line == '\0')
-        {
-            return INI_LINE_INVALID;
-        }
+    event->section = *section;
+    event->sectionId = *sectionId;
+    event->line = record->line;
+}
 
-        size_t keyLen = line - keyStart;
-        keyLen = (keyLen < INI_MAX_LINE_LENGTH - 1) ? keyLen : INI_MAX_LINE_LENGTH - 1;
-        memcpy(key, keyStart, keyLen);
-        key[keyLen] = '\0';
-        trimWhitespace(key);
+static bool sectionWanted(const ini_options_t *options, ini_span_t name)
+{
+    for(size_t i = 0; i < options->sectionFilterCount; i++)
+    {
+        const char *wanted = options->sectionFilter[i];
 
-        if(key[0] == '\0')
+        if(namesEqual(wanted, strlen(wanted), name.ptr, name.len))
         {
-            return INI_LINE_INVALID;
+            return true;
         }
+    }
 
-        line++;
+    return options->sectionFilter == NULL;
+}
 
-        while(isspace((unsigned char)*line))
+// Where the stream parsers deliver records: a classic handler gets terminated copies, a span
+// handler one event pointing into the input, and a batch handler full arrays of those.
+// Records outside the sections of options->sectionFilter are dropped here.
+typedef struct
+{
+    const ini_options_t *options;
+    bool skipping;
+    ini_handler handler;
+    ini_span_handler spanHandler;
+    ini_batch_handler batchHandler;
+    void *userdata;
+    ini_event_t *events;
+    size_t capacity;
+    size_t count;
+    ini_span_t section;
+    uint32_t sectionId;
+    char current_section[INI_MAX_LINE_LENGTH];
+    char text[INI_MAX_LINE_LENGTH];
+} ini_emitter_t;
+
+static bool emit(ini_emitter_t *emitter, const ini_record_t *record)
+{
+    if(emitter->options->sectionFilter)
+    {
+        if(record->type == INI_LINE_SECTION)
         {
-            line++;
+            emitter->skipping = !sectionWanted(emitter->options, record->first);
         }
 
-        const char *valueStart = line;
-
-        while(*line && *line != '\r' && *line != '\n')
+        if(emitter->skipping)
         {
-            line++;
+            // Skipped headers still count towards the section ids
+            emitter->sectionId += record->type == INI_LINE_SECTION;
+            return true;
         }
+    }
 
-        size_t valueLen = line - valueStart;
-        valueLen = (valueLen < INI_MAX_LINE_LENGTH - 1) ? valueLen : INI_MAX_LINE_LENGTH - 1;
-        memcpy(value, valueStart, valueLen);
-        value[valueLen] = '\0';
-        trimWhitespace(value);
-#ifndef INI_ALLOW_EMPTY_VALUES
+    if(emitter->handler)
+    {
+        return emitRecord(record, emitter->current_section, emitter->text, emitter->handler,
+                          emitter->userdata);
+    }
 
-        if(value[0] == '\0')
-        {
-            return INI_LINE_INVALID;
-        }
+    if(emitter->spanHandler)
+    {
+        ini_event_t event;
+        recordEvent(record, &emitter->section, &emitter->sectionId, &event);
+        return emitter->spanHandler(&event, emitter->userdata);
+    }
 
-#endif
-        return INI_LINE_KEY_VALUE;
+    recordEvent(record, &emitter->section, &emitter->sectionId, &emitter->events[emitter->count++]);
+
+    if(emitter->count < emitter->capacity)
+    {
+        return true;
     }
 
-    return INI_LINE_INVALID;
+    emitter->count = 0;
+    return emitter->batchHandler(emitter->events, emitter->capacity, emitter->userdata);
 }
 
-bool ini_initialize(ini_context_t *ctx, const char *content, size_t length)
+// The options->skipEvents bit covering a line. Section lines have none: they set the section
+// of the events after them, so they are always reported.
+static unsigned skipBit(ini_linetype_t type)
 {
-    if(!ctx || !content || length == 0)
+    switch(type)
     {
-        return false;
-    }
+        case INI_LINE_KEY_VALUE:
+            return INI_EVENT_MASK(INI_EVENT_KEY_VALUE);
 
-    ctx->content = NULL;
-    ctx->sections = NULL;
-    ctx->content = calloc(1, length + 1);
+        case INI_LINE_COMMENT:
+            return INI_EVENT_MASK(INI_EVENT_COMMENT);
 
-    if(!ctx->content)
-    {
-        return false;
-    }
+        case INI_LINE_INVALID:
+            return INI_EVENT_MASK(INI_EVENT_ERROR);
 
-    memcpy(ctx->content, content, length);
-    ctx->content[length] = '\0';
-    ctx->sections = NULL;
-    ini_section_t *currentSection = NULL;
-    char line[INI_MAX_LINE_LENGTH];
-    const char *ptr = ctx->content;
-    bool has_valid_entries = false;
+        default:
+            return 0;
+    }
+}
 
-    while(*ptr)
+typedef struct
+{
+    const char *start;
+    size_t length;
+    const ini_options_t *options;
+    bool countLines;
+    ini_record_t *records;
+    size_t recordCount;
+    size_t recordCapacity;
+    size_t lineBreaks;
+    bool ok;
+} ini_stream_task_t;
+
+static void scanRecordsTask(void *task)
+{
+    ini_stream_task_t *t = (ini_stream_task_t *)task;
+    const ini_options_t *options = t->options;
+    ini_lexer_t lexer;
+    ini_line_t line;
+    // Whether the lines before the first header are wanted depends on the chunks before this
+    // one, so they are recorded and left to the emitter
+    bool skipping = false;
+    t->recordCount = 0;
+    t->ok = lexerInit(&lexer, t->start, t->length, options->engine);
+
+    while(t->ok && lexerNext(&lexer, &line))
     {
-        const char *start = ptr;
-        size_t len = 0;
+        if(line.type == INI_LINE_SECTION)
+        {
+            skipping = !sectionWanted(options, line.section);
+        }
 
-        while(*ptr && *ptr != '\n' && *ptr != '\r' && len < INI_MAX_LINE_LENGTH)
+        if(!(skipBit(line.type) & options->skipEvents) && (!skipping || line.type == INI_LINE_SECTION))
         {
-            ptr++;
-            len++;
+            if(t->recordCount == t->recordCapacity &&
+                    !growArray((void **)&t->records, &t->recordCapacity, sizeof(ini_record_t)))
+            {
+                t->ok = false;
+                break;
+            }
+
+            recordLine(&line, &t->records[t->recordCount++]);
         }
 
-        if(len > 0 && start[len - 1] == '\r')
+        if(skipping)
         {
-            len--;
+            lexerSkip(&lexer, t->countLines);
         }
+    }
 
-        memcpy(line, start, len);
-        line[len] = '\0';
-        char section[INI_MAX_LINE_LENGTH] = {0};
-        char key[INI_MAX_LINE_LENGTH] = {0};
-        char value[INI_MAX_LINE_LENGTH] = {0};
-        ini_linetype_t type = parseLine(line, section, key, value);
+    t->lineBreaks = lexer.line - 1;
+    lexerFree(&lexer);
+}
 
-        if(type == INI_LINE_SECTION)
-        {
-            ini_section_t *newSection = calloc(1, sizeof(ini_section_t));
+// Rounds of up to threads * INI_PARALLEL_CHUNK bytes are tokenized concurrently, then reported
+// on the calling thread in input order. Handlers therefore need no locking, and the current
+// section carries across chunks and rounds exactly as in a sequential parse.
+static bool streamParallel(const char *content, size_t length, const ini_options_t *options,
+                           ini_emitter_t *emitter)
+{
+    unsigned threads = options->threads;
+    const char **starts = INI_MALLOC((threads + 1) * sizeof(const char *));
+    ini_stream_task_t *tasks = INI_CALLOC(threads, sizeof(ini_stream_task_t));
+    const char *ptr = content;
+    const char *end = content + length;
+    size_t lineBase = 0;
+    bool ok = starts && tasks;
 
-            if(!newSection)
-            {
-                ini_cleanup(ctx);
-                return false;
-            }
+    while(ok && ptr < end)
+    {
+        size_t count = chunkCount((size_t)(end - ptr), threads);
+        const char *roundEnd = end;
 
-            strncpy(newSection->name, section, INI_MAX_LINE_LENGTH);
-            newSection->keyValues = NULL;
-            newSection->next = NULL;
+        if((size_t)(end - ptr) > count * INI_PARALLEL_CHUNK)
+        {
+            roundEnd = findAny2(ptr + count * INI_PARALLEL_CHUNK, end, '\n', '\r');
 
-            if(!ctx->sections)
+            while(roundEnd < end && hasClass(*roundEnd, INI_CHAR_NEWLINE))
             {
-                ctx->sections = newSection;
+                roundEnd++;
             }
-            else
-            {
-                ini_section_t *last = ctx->sections;
-
-                while(last->next)
-                {
-                    last = last->next;
-                }
+        }
 
-                last->next = newSection;
-            }
+        splitChunks(ptr, roundEnd, count, starts);
 
-            currentSection = newSection;
-            has_valid_entries = true;
-        }
-        else if(type == INI_LINE_KEY_VALUE && currentSection)
+        for(size_t i = 0; i < count; i++)
         {
-            ini_keyvalue_t *newKv = calloc(1, sizeof(ini_keyvalue_t));
+            tasks[i].start = starts[i];
+            tasks[i].length = (size_t)(starts[i + 1] - starts[i]);
+            tasks[i].options = options;
+            tasks[i].countLines = emitter->handler == NULL;
+        }
 
-            if(!newKv)
-            {
-                ini_cleanup(ctx);
-                return false;
-            }
+        runTasks(scanRecordsTask, tasks, sizeof(ini_stream_task_t), count);
 
-            strncpy(newKv->key, key, INI_MAX_LINE_LENGTH - 1);
-            newKv->key[INI_MAX_LINE_LENGTH - 1] = '\0';
-            strncpy(newKv->value, value, INI_MAX_LINE_LENGTH - 1);
-            newKv->value[INI_MAX_LINE_LENGTH - 1] = '\0';
-            newKv->next = NULL;
+        for(size_t i = 0; ok && i < count; i++)
+        {
+            ok = tasks[i].ok;
 
-            if(!currentSection->keyValues)
-            {
-                currentSection->keyValues = newKv;
-            }
-            else
+            // Chunks number their lines from 1; chunk boundaries never split a "\r\n"
+            for(size_t r = 0; ok && r < tasks[i].recordCount; r++)
             {
-                ini_keyvalue_t *last = currentSection->keyValues;
-
-                while(last->next)
-                {
-                    last = last->next;
-                }
-
-                last->next = newKv;
+                tasks[i].records[r].line += lineBase;
+                ok = emit(emitter, &tasks[i].records[r]);
             }
 
-            has_valid_entries = true;
-        }
-
-        if(*ptr)
-        {
-            ptr++;
+            lineBase += tasks[i].lineBreaks;
         }
 
-        while(*ptr == '\r' || *ptr == '\n')
-        {
-            ptr++;
-        }
+        ptr = roundEnd;
     }
 
-    if(!has_valid_entries)
+    for(size_t i = 0; tasks && i < threads; i++)
     {
-        ini_cleanup(ctx);
-        return false;
+        INI_FREE(tasks[i].records);
     }
 
-    return true;
+    INI_FREE(starts);
+    INI_FREE(tasks);
+    return ok;
 }
 
-void ini_cleanup(ini_context_t *ctx)
+// options->engine, options->threads, options->skipEvents and options->sectionFilter apply to
+// streaming; duplicates are reported as they occur
+static bool streamRecords(const char *content, size_t length, const ini_options_t *options,
+                          ini_emitter_t *emitter)
 {
-    if(!ctx)
+    if(!options)
     {
-        return;
+        options = &defaultOptions;
+    }
+
+    // With a filter, lines before the first header belong to no wanted section
+    emitter->options = options;
+    emitter->skipping = options->sectionFilter != NULL;
+
+    if(options->threads > 1)
+    {
+        return streamParallel(content, length, options, emitter);
+    }
+
+    ini_lexer_t lexer;
+    ini_line_t line;
+    ini_record_t record;
+    bool skipping = emitter->skipping;
+    bool countLines = emitter->handler == NULL;
+
+    if(!lexerInit(&lexer, content, length, options->engine))
+    {
+        return false;
     }
 
-    if(ctx->content)
+    if(skipping)
     {
-        free(ctx->content);
-        ctx->content = NULL;
+        lexerSkip(&lexer, countLines);
     }
 
-    ini_section_t *section = ctx->sections;
+    bool ok = true;
 
-    while(section)
+    while(ok && lexerNext(&lexer, &line))
     {
-        ini_section_t *next_section = section->next;
-        ini_keyvalue_t *kv = section->keyValues;
+        if(line.type == INI_LINE_SECTION)
+        {
+            skipping = !sectionWanted(options, line.section);
+        }
 
-        while(kv)
+        // Skipped lines are dropped before anything is copied or called. Headers of unwanted
+        // sections still reach the emitter, which counts them and stops reporting.
+        if(!(skipBit(line.type) & options->skipEvents) && (!skipping || line.type == INI_LINE_SECTION))
         {
-            ini_keyvalue_t *next_kv = kv->next;
-            free(kv);
-            kv = next_kv;
+            recordLine(&line, &record);
+            ok = emit(emitter, &record);
         }
 
-        free(section);
-        section = next_section;
+        if(skipping)
+        {
+            lexerSkip(&lexer, countLines);
+        }
     }
 
-    ctx->sections = NULL;
+    lexerFree(&lexer);
+    return ok;
 }
 
-bool ini_hasSection(const ini_context_t *ctx, const char *section)
+bool ini_parse_stream(const char *content, size_t length, ini_handler handler, void *userdata)
 {
-    if(!ctx || !section)
+    return ini_parse_stream_ex(content, length, handler, userdata, NULL);
+}
+
+bool ini_parse_stream_ex(const char *content, size_t length, ini_handler handler, void *userdata,
+                         const ini_options_t *options)
+{
+    if(!content || !handler)
     {
         return false;
     }
 
-    ini_section_t *current = ctx->sections;
+    ini_emitter_t emitter;
+    memset(&emitter, 0, sizeof(ini_emitter_t));
+    emitter.handler = handler;
+    emitter.userdata = userdata;
+    return streamRecords(content, length, options, &emitter);
+}
 
-    while(current)
+// Events point into content, so tokens are neither copied nor terminated
+bool ini_parse_stream_spans(const char *content, size_t length, ini_span_handler handler, void *userdata,
+                            const ini_options_t *options)
+{
+    if(!content || !handler)
     {
-        if(STRCOMPARE(current->name, section) == 0)
-        {
-            return true;
-        }
-
-        current = current->next;
+        return false;
     }
 
-    return false;
+    ini_emitter_t emitter;
+    memset(&emitter, 0, sizeof(ini_emitter_t));
+    emitter.spanHandler = handler;
+    emitter.userdata = userdata;
+    emitter.section.ptr = content;
+    return streamRecords(content, length, options, &emitter);
 }
 
-bool ini_hasKey(const ini_context_t *ctx, const char *section, const char *key)
+// Fills events and hands them over capacity at a time, plus a final partial batch. The array
+// is reused for the next batch as soon as the handler returns.
+bool ini_parse_stream_batch(const char *content, size_t length, ini_event_t *events, size_t capacity,
+                            ini_batch_handler handler, void *userdata, const ini_options_t *options)
 {
-    if(!ctx || !section || !key)
+    if(!content || !events || capacity == 0 || !handler)
     {
         return false;
     }
 
-    ini_section_t *current = ctx->sections;
+    ini_emitter_t emitter;
+    memset(&emitter, 0, sizeof(ini_emitter_t));
+    emitter.batchHandler = handler;
+    emitter.userdata = userdata;
+    emitter.events = events;
+    emitter.capacity = capacity;
+    emitter.section.ptr = content;
 
-    while(current)
+    if(!streamRecords(content, length, options, &emitter))
     {
-        if(STRCOMPARE(current->name, section) == 0)
-        {
-            ini_keyvalue_t *kv = current->keyValues;
-
-            while(kv)
-            {
-                if(STRCOMPARE(kv->key, key) == 0)
-                {
-                    return true;
-                }
-
-                kv = kv->next;
-            }
-
-            return false;
-        }
-
-        current = current->next;
+        return false;
     }
 
-    return false;
+    return emitter.count == 0 || handler(events, emitter.count, userdata);
 }
 
-bool ini_hasValue(const ini_context_t *ctx, const char *section, const char *key)
+bool ini_reader_init(ini_reader_t *reader, const char *content, size_t length)
 {
-    char value[INI_MAX_LINE_LENGTH];
-    return ini_getValue(ctx, section, key, value, sizeof(value)) && value[0] != '\0';
+    if(!reader || !content)
+    {
+        return false;
+    }
+
+    reader->ptr = content;
+    reader->end = content + length;
+    reader->section.ptr = content;
+    reader->section.len = 0;
+    reader->sectionId = 0;
+    reader->line = 1;
+    return true;
 }
 
-bool ini_getValue(const ini_context_t *ctx, const char *section, const char *key,
-                  char *value, size_t maxLen)
+// Tokenizes up to the next non-empty line and describes it with spans into the input, which
+// must stay valid while they are used. Returns false at the end of the input.
+bool ini_reader_next(ini_reader_t *reader, ini_event_t *event)
 {
-    if(!ctx || !section || !key || !value || maxLen == 0)
+    if(!reader || !event)
     {
         return false;
     }
 
-    ini_section_t *current = ctx->sections;
-    bool found = false;
+    ini_lexer_t lexer;
+    ini_line_t line;
+    ini_record_t record;
+    lexerInit(&lexer, reader->ptr, (size_t)(reader->end - reader->ptr), INI_ENGINE_LINEAR);
+    lexer.line = reader->line;
+    bool found = nextLineLinear(&lexer, &line);
+    reader->ptr = lexer.ptr;
+    reader->line = lexer.line;
 
-    while(current)
+    if(!found)
     {
-        if(STRCOMPARE(current->name, section) == 0)
-        {
-            ini_keyvalue_t *kv = current->keyValues;
+        return false;
+    }
 
-            while(kv)
-            {
-                if(STRCOMPARE(kv->key, key) == 0)
-                {
-                    strncpy(value, kv->value, maxLen);
-                    value[maxLen - 1] = '\0';
-                    found = true;
-                }
+    recordLine(&line, &record);
+    recordEvent(&record, &reader->section, &reader->sectionId, event);
+    return true;
+}
 
-                kv = kv->next;
-            }
+// Reports the complete line [start, end), already capped to the line length limit
+static bool pushLine(ini_push_t *parser, const char *start, const char *end, char *text)
+{
+    ini_line_t line;
+    ini_record_t record;
+    line.start = start;
+    line.end = end;
+    // Handlers of the push parser never see line numbers, so lines are not counted
+    line.number = 0;
+    line.type = scanLine(start, end, NULL, NULL, &line);
+
+    if(line.type == INI_LINE_EMPTY)
+    {
+        return true;
+    }
 
-            return found;
-        }
+    recordLine(&line, &record);
+    parser->stopped = !emitRecord(&record, parser->section, text, parser->handler, parser->userdata);
+    return !parser->stopped;
+}
+
+// Keeps the part of a line that continues in the next chunk. Bytes past the line length limit
+// would be cut off anyway, so no more than INI_MAX_LINE_LENGTH - 1 are stored.
+static void carryLine(ini_push_t *parser, const char *start, const char *end)
+{
+    size_t room = INI_MAX_LINE_LENGTH - 1 - parser->lineLength;
+    size_t len = (size_t)(end - start) < room ? (size_t)(end - start) : room;
+    memcpy(parser->line + parser->lineLength, start, len);
+    parser->lineLength += len;
+}
 
-        current = current->next;
+bool ini_push_init(ini_push_t *parser, ini_handler handler, void *userdata)
+{
+    if(!parser || !handler)
+    {
+        return false;
     }
 
-    return false;
+    memset(parser, 0, sizeof(ini_push_t));
+    parser->handler = handler;
+    parser->userdata = userdata;
+    return true;
 }
 
-bool ini_parse_stream(const char *content, size_t length, ini_handler handler, void *userdata)
+// Chunks may end anywhere, including inside a line or between '\r' and '\n'. Complete lines
+// are tokenized straight from data; events are the same as ini_parse_stream on the whole input.
+bool ini_push_feed(ini_push_t *parser, const char *data, size_t length)
 {
-    if(!content || !handler)
+    if(!parser || (!data && length > 0) || parser->stopped)
     {
         return false;
     }
 
-    const char *ptr = content;
-    const char *end = content + length;
-    char line[INI_MAX_LINE_LENGTH];
-    char current_section[INI_MAX_LINE_LENGTH] = "";
+    if(length == 0)
+    {
+        return true;
+    }
 
-    while(ptr < end)
+    char text[INI_MAX_LINE_LENGTH];
+    const char *ptr = data;
+    const char *end = data + length;
+
+    if(parser->lineLength > 0)
     {
-        // Extract line
-        const char *line_start = ptr;
+        const char *lineEnd = findAny2(ptr, end, '\n', '\r');
+        carryLine(parser, ptr, lineEnd);
 
-        while(ptr < end && *ptr != '\n' && *ptr != '\r')
+        if(lineEnd == end)
         {
-            ptr++;
+            return true;
         }
 
-        size_t line_len = ptr - line_start;
+        size_t lineLength = parser->lineLength;
+        parser->lineLength = 0;
 
-        // Handle line endings
-        while(ptr < end && (*ptr == '\n' || *ptr == '\r'))
+        if(!pushLine(parser, parser->line, parser->line + lineLength, text))
         {
-            ptr++;
+            return false;
         }
 
-        // Process line
-        if(line_len > 0)
-        {
-            line_len = line_len < INI_MAX_LINE_LENGTH - 1 ? line_len : INI_MAX_LINE_LENGTH - 1;
-            memcpy(line, line_start, line_len);
-            line[line_len] = '\0';
-            char section[INI_MAX_LINE_LENGTH] = "";
-            char key[INI_MAX_LINE_LENGTH] = "";
-            char value[INI_MAX_LINE_LENGTH] = "";
-            ini_linetype_t type = parseLine(line, section, key, value);
-
-            switch(type)
-            {
-                case INI_LINE_SECTION:
-                    strncpy(current_section, section, INI_MAX_LINE_LENGTH);
-
-                    if(!handler(INI_EVENT_SECTION, current_section, NULL, NULL, userdata))
-                    {
-                        return false;
-                    }
-
-                    break;
+        ptr = lineEnd;
+    }
 
-                case INI_LINE_KEY_VALUE:
-                    if(!handler(INI_EVENT_KEY_VALUE, current_section, key, value, userdata))
-                    {
-                        return false;
-                    }
+    while(ptr < end)
+    {
+        if(hasClass(*ptr, INI_CHAR_NEWLINE))
+        {
+            ptr++;
+            continue;
+        }
 
-                    break;
+        const char *lineEnd = findAny2(ptr, end, '\n', '\r');
 
-                case INI_LINE_COMMENT:
-                    if(!handler(INI_EVENT_COMMENT, NULL, NULL, line, userdata))
-                    {
-                        return false;
-                    }
+        if(lineEnd == end)
+        {
+            carryLine(parser, ptr, end);
+            break;
+        }
 
-                    break;
+        if(!pushLine(parser, ptr, capLine(ptr, lineEnd), text))
+        {
+            return false;
+        }
 
-                case INI_LINE_INVALID:
-                    if(!handler(INI_EVENT_ERROR, NULL, NULL, line, userdata))
-                    {
-                        return false;
-                    }
+        ptr = lineEnd;
+    }
 
-                    break;
+    return true;
+}
 
-                default:
-                    break;
-            }
-        }
+// Reports a last line that has no line ending. Returns false if the handler stopped the parse.
+bool ini_push_finish(ini_push_t *parser)
+{
+    if(!parser || parser->stopped)
+    {
+        return false;
     }
 
-    return true;
+    char text[INI_MAX_LINE_LENGTH];
+    size_t lineLength = parser->lineLength;
+    parser->lineLength = 0;
+    return lineLength == 0 || pushLine(parser, parser->line, parser->line + lineLength, text);
 }
 
 #endif /* INI_PARSER_IMPLEMENTATION */
\ No newline at end of file
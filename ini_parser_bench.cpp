@@ -0,0 +1,196 @@
+/**
+    @brief INI Parser Library
+
+    A lightweight, single-header, speed and safety focused INI file parsing library written in C with C++ compatibility. Designed for simplicity and portability, this parser provides a low-footprint solution to decode INI format.
+
+    @date 2025-05-12
+    @version 1.0
+    @author Eray Ozturk | erayozturk1@gmail.com
+    @url github.com/diffstorm
+    @license MIT License
+*/
+#include "ini_parser.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Usage: ini_parser_bench [megabytes] [rounds]
+// Parses a synthetic file of many short lines and reports the best throughput of each API.
+
+static std::string makeInput(size_t bytes)
+{
+    std::string content;
+    content.reserve(bytes + 256);
+
+    for(size_t s = 0; content.size() < bytes; s++)
+    {
+        content += "[section_" + std::to_string(s) + "]\n; comment " + std::to_string(s) + "\n";
+
+        for(size_t k = 0; k < 64 && content.size() < bytes; k++)
+        {
+            content += "k" + std::to_string(k) + "=v" + std::to_string(k * s % 1000) + "\n";
+        }
+    }
+
+    return content;
+}
+
+static bool countEvent(ini_eventtype_t, const char *, const char *, const char *, void *userdata)
+{
+    ++*static_cast<size_t *>(userdata);
+    return true;
+}
+
+static bool countSpan(const ini_event_t *, void *userdata)
+{
+    ++*static_cast<size_t *>(userdata);
+    return true;
+}
+
+static bool countBatch(const ini_event_t *, size_t count, void *userdata)
+{
+    *static_cast<size_t *>(userdata) += count;
+    return true;
+}
+
+template <typename F>
+static double bestSeconds(int rounds, F run)
+{
+    double best = 1e30;
+
+    for(int r = 0; r < rounds; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        if(!run())
+        {
+            return -1;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = elapsed.count() < best ? elapsed.count() : best;
+    }
+
+    return best;
+}
+
+static void report(const char *name, size_t bytes, double seconds)
+{
+    if(seconds < 0)
+    {
+        std::printf("%-12s failed\n", name);
+        return;
+    }
+
+    std::printf("%-12s %8.1f MB/s\n", name, bytes / 1e6 / seconds);
+}
+
+int main(int argc, char **argv)
+{
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+    std::string content = makeInput((megabytes ? megabytes : 1) << 20);
+    size_t lines = 0;
+
+    for(char c : content)
+    {
+        lines += c == '\n';
+    }
+
+    std::printf("input        %zu bytes, %zu lines, kernel %s\n", content.size(), lines, ini_getKernel());
+
+    const struct
+    {
+        const char *name;
+        ini_engine_t engine;
+        unsigned threads;
+    } engines[] = { { "linear", INI_ENGINE_LINEAR, 1 }, { "structural", INI_ENGINE_STRUCTURAL, 1 },
+        { "linear x4", INI_ENGINE_LINEAR, 4 }, { "structural x4", INI_ENGINE_STRUCTURAL, 4 }
+    };
+    std::string buffer;
+
+    for(const auto &engine : engines)
+    {
+        ini_options_t options = {};
+        options.engine = engine.engine;
+        options.threads = engine.threads;
+        std::printf("engine       %s\n", engine.name);
+
+        report("stream", content.size(), bestSeconds(rounds, [&]
+        {
+            size_t events = 0;
+            return ini_parse_stream_ex(content.data(), content.size(), countEvent, &events, &options) &&
+                   events > 0;
+        }));
+
+        report("spans", content.size(), bestSeconds(rounds, [&]
+        {
+            size_t events = 0;
+            return ini_parse_stream_spans(content.data(), content.size(), countSpan, &events, &options) &&
+                   events > 0;
+        }));
+
+        report("batch", content.size(), bestSeconds(rounds, [&]
+        {
+            ini_event_t batch[256];
+            size_t events = 0;
+            return ini_parse_stream_batch(content.data(), content.size(), batch, 256, countBatch, &events,
+                                          &options) && events > 0;
+        }));
+
+        report("initialize", content.size(), bestSeconds(rounds, [&]
+        {
+            ini_context_t ctx;
+            bool ok = ini_initialize_ex(&ctx, content.data(), content.size(), &options);
+            ini_cleanup(&ctx);
+            return ok;
+        }));
+
+        report("insitu", content.size(), bestSeconds(rounds, [&]
+        {
+            // Includes restoring the text the previous round tokenized in place
+            buffer = content;
+            ini_context_t ctx;
+            bool ok = ini_initialize_insitu_ex(&ctx, &buffer[0], buffer.size(), &options);
+            ini_cleanup(&ctx);
+            return ok;
+        }));
+    }
+
+    ini_options_t lazy = {};
+    lazy.lazy = true;
+    std::printf("engine       lazy\n");
+
+    report("initialize", content.size(), bestSeconds(rounds, [&]
+    {
+        // Startup plus one lookup, which loads a single section
+        ini_context_t ctx;
+        bool ok = ini_initialize_ex(&ctx, content.data(), content.size(), &lazy) &&
+                  ini_hasKey(&ctx, "section_1", "k1");
+        ini_cleanup(&ctx);
+        return ok;
+    }));
+
+    const char *wanted[] = { "section_1", "section_500", "section_9999" };
+    ini_options_t filter = {};
+    filter.sectionFilter = wanted;
+    filter.sectionFilterCount = 3;
+    std::printf("engine       filter of 3 sections\n");
+
+    report("stream", content.size(), bestSeconds(rounds, [&]
+    {
+        size_t events = 0;
+        return ini_parse_stream_ex(content.data(), content.size(), countEvent, &events, &filter) && events > 0;
+    }));
+
+    report("batch", content.size(), bestSeconds(rounds, [&]
+    {
+        ini_event_t batch[256];
+        size_t events = 0;
+        return ini_parse_stream_batch(content.data(), content.size(), batch, 256, countBatch, &events, &filter) &&
+               events > 0;
+    }));
+
+    return 0;
+}
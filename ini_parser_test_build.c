@@ -0,0 +1,82 @@
+/**
+    @brief INI Parser Library
+
+    A lightweight, single-header, speed and safety focused INI file parsing library written in C with C++ compatibility. Designed for simplicity and portability, this parser provides a low-footprint solution to decode INI format.
+
+    @date 2025-05-12
+    @version 1.0
+    @author Eray Ozturk | erayozturk1@gmail.com
+    @url github.com/diffstorm
+    @license MIT License
+*/
+
+// The library as the tests build it: every allocation goes through hooks that count it and
+// can be told to fail, so out-of-memory paths can be exercised; index probes are counted; and
+// perfect hash seeds run out early, so ini_freeze meets the table sizes where a seed search
+// falls short at a few thousand keys.
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+static long allocationsLeft = -1;
+// Parallel parses allocate and probe on worker threads too
+static atomic_ulong allocations;
+static atomic_ulong probes;
+
+unsigned long ini_test_allocations(void)
+{
+    return atomic_load(&allocations);
+}
+
+unsigned long ini_test_probes(void)
+{
+    return atomic_load(&probes);
+}
+
+// Lets count more allocations succeed and fails every one after them; -1 never fails
+void ini_test_failAllocationsAfter(long count)
+{
+    allocationsLeft = count;
+}
+
+static int allocationFails(void)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+
+    if(allocationsLeft < 0)
+    {
+        return 0;
+    }
+
+    if(allocationsLeft == 0)
+    {
+        return 1;
+    }
+
+    allocationsLeft--;
+    return 0;
+}
+
+static void *testMalloc(size_t size)
+{
+    return allocationFails() ? NULL : malloc(size);
+}
+
+static void *testCalloc(size_t count, size_t size)
+{
+    return allocationFails() ? NULL : calloc(count, size);
+}
+
+static void *testRealloc(void *ptr, size_t size)
+{
+    return allocationFails() ? NULL : realloc(ptr, size);
+}
+
+#define INI_MALLOC testMalloc
+#define INI_CALLOC testCalloc
+#define INI_REALLOC testRealloc
+#define INI_FREE free
+#define INI_PERFECT_HASH_MAX_SEED 4096
+#define INI_COUNT_PROBE() atomic_fetch_add_explicit(&probes, 1, memory_order_relaxed)
+#define INI_PARSER_IMPLEMENTATION
+#include "ini_parser.h"
@@ -11,8 +11,17 @@
 */
 #include <gtest/gtest.h>
 #include "ini_parser.h"
+#include <algorithm>
+#include <map>
 #include <string>
+#include <vector>
 #include <cstring>
+#include <clocale>
+
+// From ini_parser_test_build.c, the library build the tests link against
+extern "C" void ini_test_failAllocationsAfter(long count);
+extern "C" unsigned long ini_test_allocations(void);
+extern "C" unsigned long ini_test_probes(void);
 
 class IniParserTest : public ::testing::Test
 {
@@ -421,28 +430,26 @@ key3 = 3
     EXPECT_STREQ(buffer, "value");
 
     // Order Preservation
-    ini_section_t* section = ctx.sections;
-    while(section && STRCOMPARE(section->name, "Order_Verification") != 0) {
-        section = section->next;
+    ini_section_t* section = nullptr;
+    for(size_t i = 0; i < ctx.sectionCount && !section; i++) {
+        if(STRCOMPARE(ctx.sections[i].name, "Order_Verification") == 0) {
+            section = &ctx.sections[i];
+        }
     }
     ASSERT_NE(section, nullptr) << "Order_Verification section not found";
+    ASSERT_EQ(section->keyCount, 3u) << "Unexpected key count in Order_Verification";
     
-    ini_keyvalue_t* kv = section->keyValues;
-    ASSERT_NE(kv, nullptr) << "No keys in Order_Verification";
+    ini_keyvalue_t* kv = &ctx.keyValues[section->firstKey];
     EXPECT_STREQ(kv->key, "key1");
     EXPECT_STREQ(kv->value, "1");
     
-    kv = kv->next;
-    ASSERT_NE(kv, nullptr) << "Missing key2";
+    kv++;
     EXPECT_STREQ(kv->key, "key2");
     EXPECT_STREQ(kv->value, "2");
     
-    kv = kv->next;
-    ASSERT_NE(kv, nullptr) << "Missing key3";
+    kv++;
     EXPECT_STREQ(kv->key, "key3");
     EXPECT_STREQ(kv->value, "3");
-    
-    EXPECT_EQ(kv->next, nullptr) << "Extra unexpected keys in section";
 }
 
 TEST_F(IniParserTest, StreamingAPIParsing) {
@@ -559,6 +566,1294 @@ TEST_F(IniParserTest, StreamingAPIEdgeCases) {
     }
 }
 
+// Whether lookups ignore ASCII case, which INI_ENABLE_CASE_SENSITIVITY turns off
+#ifdef INI_ENABLE_CASE_SENSITIVITY
+static const bool foldsCase = false;
+#else
+static const bool foldsCase = true;
+#endif
+
+TEST_F(IniParserTest, IndexedLookupAcrossManySections)
+{
+    std::string content;
+
+    for(int s = 0; s < 500; s++)
+    {
+        content += "[Section" + std::to_string(s) + "]\n";
+
+        for(int k = 0; k < 20; k++)
+        {
+            content += "Key" + std::to_string(k) + "=" + std::to_string(s * 100 + k) + "\n";
+        }
+    }
+
+    ASSERT_TRUE(ini_initialize(&ctx, content.c_str(), content.size()));
+    char value[INI_MAX_LINE_LENGTH];
+
+    for(int s = 0; s < 500; s++)
+    {
+        std::string section = (foldsCase ? "section" : "Section") + std::to_string(s);
+        ASSERT_TRUE(ini_hasSection(&ctx, section.c_str()));
+
+        for(int k = 0; k < 20; k++)
+        {
+            std::string key = (foldsCase ? "KEY" : "Key") + std::to_string(k);
+            ASSERT_TRUE(ini_getValue(&ctx, section.c_str(), key.c_str(), value, sizeof(value)));
+            EXPECT_EQ(std::to_string(s * 100 + k), value);
+        }
+
+        EXPECT_FALSE(ini_hasKey(&ctx, section.c_str(), "Key20"));
+    }
+
+    EXPECT_FALSE(ini_hasSection(&ctx, "Section500"));
+    EXPECT_FALSE(ini_hasKey(&ctx, "Section500", "Key0"));
+}
+
+TEST_F(IniParserTest, ArenaStorageIsCompact)
+{
+    std::string content = "[server]\n";
+
+    for(int k = 0; k < 100; k++)
+    {
+        content += "port" + std::to_string(k) + "=80\n";
+    }
+
+    ASSERT_TRUE(ini_initialize(&ctx, content.c_str(), content.size()));
+    size_t reserved = 0;
+
+    for(ini_arena_block_t *block = ctx.arena; block; block = block->next)
+    {
+        reserved += block->size;
+    }
+
+    // A fixed 2 * INI_MAX_LINE_LENGTH per entry was the previous footprint
+    EXPECT_LT(reserved, 100 * INI_MAX_LINE_LENGTH);
+    char value[INI_MAX_LINE_LENGTH];
+    EXPECT_TRUE(ini_getValue(&ctx, "server", "port99", value, sizeof(value)));
+    EXPECT_STREQ(value, "80");
+    ini_cleanup(&ctx);
+    EXPECT_EQ(ctx.arena, nullptr);
+    EXPECT_EQ(ctx.sections, nullptr);
+    EXPECT_EQ(ctx.keyValues, nullptr);
+}
+
+static std::string MakeSyntheticIni(size_t sections, size_t keysPerSection)
+{
+    std::string content;
+
+    for(size_t s = 0; s < sections; s++)
+    {
+        content += "[s" + std::to_string(s) + "]\n";
+
+        for(size_t k = 0; k < keysPerSection; k++)
+        {
+            content += "k" + std::to_string(k) + "=v\n";
+        }
+    }
+
+    return content;
+}
+
+// Allocations and index probes of one ini_initialize, as counted by the test build
+struct InitializeWork
+{
+    unsigned long allocations;
+    unsigned long probes;
+};
+
+static InitializeWork CountInitializeWork(const std::string &content)
+{
+    ini_context_t ctx{};
+    unsigned long allocations = ini_test_allocations();
+    unsigned long probes = ini_test_probes();
+    EXPECT_TRUE(ini_initialize(&ctx, content.c_str(), content.size()));
+    InitializeWork work = { ini_test_allocations() - allocations, ini_test_probes() - probes };
+    ini_cleanup(&ctx);
+    return work;
+}
+
+TEST_F(IniParserTest, InitializeScalesLinearly)
+{
+    // Work is counted rather than timed: index probes must stay within a constant per record,
+    // and growing the input 8x must add a few array doublings, not an allocation per record
+    for(bool manySections : { false, true })
+    {
+        InitializeWork small = CountInitializeWork(manySections ? MakeSyntheticIni(6250, 1) :
+                               MakeSyntheticIni(1, 6250));
+        InitializeWork large = CountInitializeWork(manySections ? MakeSyntheticIni(50000, 1) :
+                               MakeSyntheticIni(1, 50000));
+        EXPECT_LT(small.probes, 6250u) << manySections;
+        EXPECT_LT(large.probes, 50000u) << manySections;
+        EXPECT_LT(large.probes, small.probes * 16) << manySections;
+        EXPECT_LT(large.allocations, small.allocations + 32) << manySections;
+    }
+
+    std::string content = MakeSyntheticIni(1, 50000);
+    ASSERT_TRUE(LoadIniContent(content.c_str()));
+    EXPECT_TRUE(ini_hasKey(&ctx, "s0", "k49999"));
+}
+
+TEST_F(IniParserTest, ValueRefPointsIntoContext)
+{
+    const char *content =
+        "[net]\n"
+        "host = 127.0.0.1\n"
+        "empty =\n";
+    ASSERT_TRUE(LoadIniContent(content));
+    const char *value = nullptr;
+    size_t length = 0;
+    ASSERT_TRUE(ini_getValueRef(&ctx, foldsCase ? "NET" : "net", foldsCase ? "Host" : "host", &value, &length));
+    EXPECT_EQ(length, 9u);
+    EXPECT_STREQ(value, "127.0.0.1");
+    const char *again = nullptr;
+    EXPECT_TRUE(ini_getValueRef(&ctx, "net", "host", &again, nullptr));
+    EXPECT_EQ(again, value);
+    EXPECT_TRUE(ini_getValueRef(&ctx, "net", "empty", &value, &length));
+    EXPECT_EQ(length, 0u);
+    EXPECT_STREQ(value, "");
+    EXPECT_FALSE(ini_getValueRef(&ctx, "net", "port", &value, &length));
+    EXPECT_FALSE(ini_getValueRef(&ctx, "web", "host", &value, &length));
+    EXPECT_FALSE(ini_getValueRef(nullptr, "net", "host", &value, &length));
+    EXPECT_FALSE(ini_getValueRef(&ctx, nullptr, "host", &value, &length));
+}
+
+TEST_F(IniParserTest, InSituParsingBorrowsBuffer)
+{
+    char buffer[] =
+        "[ net ]\r\n"
+        "host = 127.0.0.1 \n"
+        "; comment\n"
+        "port=8080";
+    const size_t length = sizeof(buffer) - 1;
+    ASSERT_TRUE(ini_initialize_insitu(&ctx, buffer, length));
+    const char *value = nullptr;
+    size_t valueLength = 0;
+    ASSERT_TRUE(ini_getValueRef(&ctx, "net", "host", &value, &valueLength));
+    EXPECT_STREQ(value, "127.0.0.1");
+    EXPECT_EQ(valueLength, 9u);
+    // Tokens are terminated in place and point into the caller's buffer
+    EXPECT_GE(value, buffer);
+    EXPECT_LT(value, buffer + length);
+    EXPECT_GE(ctx.sections->name, buffer);
+    EXPECT_LT(ctx.sections->name, buffer + length);
+    // The last token touches the end of the buffer, so it cannot be terminated in place
+    ASSERT_TRUE(ini_getValueRef(&ctx, "net", "port", &value, &valueLength));
+    EXPECT_STREQ(value, "8080");
+    EXPECT_TRUE(value < buffer || value >= buffer + length);
+}
+
+TEST_F(IniParserTest, InputEndsAtFirstNul)
+{
+    // sizeof() of a literal counts its terminator, which must not end up in the last value
+    const char literal[] = "[s]\nk=v";
+    const char *value = nullptr;
+    size_t length = 0;
+    ASSERT_TRUE(ini_initialize(&ctx, literal, sizeof(literal)));
+    ASSERT_TRUE(ini_getValueRef(&ctx, "s", "k", &value, &length));
+    EXPECT_EQ(length, 1u);
+    EXPECT_STREQ(value, "v");
+    ini_cleanup(&ctx);
+
+    // Whatever follows the first NUL is ignored, in every initialization mode
+    const char content[] = "[s]\nk=v\n\0[t]\nx=1\n";
+    ini_options_t options = {};
+    options.lazy = true;
+    ASSERT_TRUE(ini_initialize_ex(&ctx, content, sizeof(content) - 1, &options));
+    EXPECT_TRUE(ini_hasKey(&ctx, "s", "k"));
+    EXPECT_FALSE(ini_hasSection(&ctx, "t"));
+    ini_cleanup(&ctx);
+    char buffer[sizeof(content)];
+    memcpy(buffer, content, sizeof(content));
+    ASSERT_TRUE(ini_initialize_insitu(&ctx, buffer, sizeof(buffer)));
+    ASSERT_TRUE(ini_getValueRef(&ctx, "s", "k", &value, &length));
+    EXPECT_EQ(length, 1u);
+    EXPECT_FALSE(ini_hasSection(&ctx, "t"));
+    ini_cleanup(&ctx);
+    EXPECT_FALSE(ini_initialize(&ctx, "\0[s]\nk=v", 8));
+}
+
+TEST_F(IniParserTest, FrozenContextLookups)
+{
+    std::string content = "[Empty]\n[Dup]\nkey=first\nkey=second\n[Dup]\nother=merged\n";
+
+    for(int s = 0; s < 300; s++)
+    {
+        content += "[Section" + std::to_string(s) + "]\n";
+
+        for(int k = 0; k < 10; k++)
+        {
+            content += "Key" + std::to_string(k) + "=" + std::to_string(s * 100 + k) + "\n";
+        }
+    }
+
+    ASSERT_TRUE(ini_initialize(&ctx, content.c_str(), content.size()));
+    ini_frozen_t frozen;
+    ASSERT_TRUE(ini_freeze(&ctx, &frozen));
+    // The frozen copy does not depend on the context
+    ini_cleanup(&ctx);
+    EXPECT_EQ(frozen.sectionCount, 302u);
+    EXPECT_EQ(frozen.entryCount, 3002u);
+    char value[INI_MAX_LINE_LENGTH];
+
+    for(int s = 0; s < 300; s++)
+    {
+        std::string section = (foldsCase ? "SECTION" : "Section") + std::to_string(s);
+        ASSERT_TRUE(ini_frozen_hasSection(&frozen, section.c_str()));
+
+        for(int k = 0; k < 10; k++)
+        {
+            std::string key = (foldsCase ? "key" : "Key") + std::to_string(k);
+            ASSERT_TRUE(ini_frozen_getValue(&frozen, section.c_str(), key.c_str(), value, sizeof(value)));
+            EXPECT_EQ(std::to_string(s * 100 + k), value);
+        }
+
+        EXPECT_FALSE(ini_frozen_hasKey(&frozen, section.c_str(), "Key10"));
+    }
+
+    const char *ref = nullptr;
+    size_t length = 0;
+    EXPECT_TRUE(ini_frozen_hasSection(&frozen, foldsCase ? "empty" : "Empty"));
+    EXPECT_FALSE(ini_frozen_hasKey(&frozen, "Empty", "key"));
+    EXPECT_TRUE(ini_frozen_getValueRef(&frozen, "Dup", "key", &ref, &length));
+    EXPECT_STREQ(ref, "second");
+    EXPECT_EQ(length, 6u);
+    EXPECT_TRUE(ini_frozen_getValueRef(&frozen, "Dup", "other", &ref, &length));
+    EXPECT_STREQ(ref, "merged");
+    EXPECT_FALSE(ini_frozen_hasSection(&frozen, "Section300"));
+    EXPECT_FALSE(ini_frozen_hasKey(&frozen, "Section1", "Key0x"));
+    EXPECT_FALSE(ini_frozen_getValue(&frozen, "Section1", "Key1", value, 0));
+    ini_frozen_cleanup(&frozen);
+    EXPECT_FALSE(ini_frozen_hasSection(&frozen, "Section1"));
+    EXPECT_FALSE(ini_freeze(nullptr, &frozen));
+}
+
+TEST_F(IniParserTest, FreezesLargeContexts)
+{
+    // The test build caps the seed search at 4096 tries, so these sizes fail wherever a
+    // bucket's search can run out of tries, as it did for 1M+ keys with the real cap
+    for(size_t keys : { 3000, 5000, 8000, 13000, 21000 })
+    {
+        std::string content = MakeSyntheticIni(1, keys);
+        ASSERT_TRUE(ini_initialize(&ctx, content.c_str(), content.size()));
+        ini_frozen_t frozen;
+        ASSERT_TRUE(ini_freeze(&ctx, &frozen)) << keys;
+        ini_cleanup(&ctx);
+        EXPECT_EQ(frozen.entryCount, keys);
+
+        for(size_t k = 0; k < keys; k++)
+        {
+            ASSERT_TRUE(ini_frozen_hasKey(&frozen, "s0", ("k" + std::to_string(k)).c_str())) << keys << " " << k;
+        }
+
+        EXPECT_FALSE(ini_frozen_hasKey(&frozen, "s0", ("k" + std::to_string(keys)).c_str()));
+        ini_frozen_cleanup(&frozen);
+    }
+}
+
+TEST_F(IniParserTest, FlatLayoutKeepsSectionKeysContiguous)
+{
+    const char *content =
+        "[a]\n"
+        "k1=1\n"
+        "k2=2\n"
+        "[empty]\n"
+        "[b]\n"
+        "k3=3\n";
+    ASSERT_TRUE(LoadIniContent(content));
+    ASSERT_EQ(ctx.sectionCount, 3u);
+    ASSERT_EQ(ctx.keyCount, 3u);
+    EXPECT_EQ(ctx.sections[0].firstKey, 0u);
+    EXPECT_EQ(ctx.sections[0].keyCount, 2u);
+    EXPECT_EQ(ctx.sections[1].keyCount, 0u);
+    EXPECT_EQ(ctx.sections[2].firstKey, 2u);
+    EXPECT_EQ(ctx.sections[2].keyCount, 1u);
+    EXPECT_STREQ(ctx.keyValues[2].key, "k3");
+    EXPECT_EQ(ctx.keyValues[2].valueLength, 1u);
+    // Equal keys in different sections must not shadow each other in the shared key index
+    EXPECT_FALSE(ini_hasKey(&ctx, "b", "k1"));
+    EXPECT_FALSE(ini_hasKey(&ctx, "empty", "k1"));
+    EXPECT_TRUE(ini_hasKey(&ctx, "a", "k2"));
+}
+
+TEST_F(IniParserTest, ResolvedHandles)
+{
+    const char *content =
+        "[http]\n"
+        "port=80\n"
+        "port=8080\n"
+        "timeout=30\n";
+    ASSERT_TRUE(LoadIniContent(content));
+    ini_handle_t port, timeout, missing;
+    ASSERT_TRUE(ini_resolve(&ctx, foldsCase ? "HTTP" : "http", foldsCase ? "Port" : "port", &port));
+    ASSERT_TRUE(ini_resolve(&ctx, "http", "timeout", &timeout));
+    EXPECT_FALSE(ini_resolve(&ctx, "http", "host", &missing));
+    EXPECT_FALSE(ini_resolve(&ctx, "ftp", "port", &missing));
+    EXPECT_FALSE(ini_resolve(&ctx, "http", "port", nullptr));
+    const char *value = nullptr;
+    size_t length = 0;
+
+    for(int i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(ini_getValueByHandle(&ctx, port, &value, &length));
+        EXPECT_STREQ(value, "8080");
+        EXPECT_EQ(length, 4u);
+    }
+
+    ASSERT_TRUE(ini_getValueByHandle(&ctx, timeout, &value, nullptr));
+    EXPECT_STREQ(value, "30");
+    ini_handle_t invalid = { 1000 };
+    EXPECT_FALSE(ini_getValueByHandle(&ctx, invalid, &value, &length));
+    EXPECT_FALSE(ini_getValueByHandle(nullptr, port, &value, &length));
+}
+
+TEST_F(IniParserTest, DuplicateKeyPolicies)
+{
+    // The second occurrence differs in case wherever lookups fold it
+    std::string content = std::string("[paths]\n"
+                                      "include=a\n"
+                                      "other=x\n") +
+                          (foldsCase ? "INCLUDE" : "include") + "=b\n"
+                          "include=c\n";
+    char value[INI_MAX_LINE_LENGTH];
+    const char *ref = nullptr;
+    size_t length = 0;
+    ini_options_t options = {};
+
+    options.duplicateKeys = INI_DUPLICATE_LAST_WINS;
+    ASSERT_TRUE(ini_initialize_ex(&ctx, content.c_str(), content.size(), &options));
+    EXPECT_EQ(ctx.keyCount, 2u);
+    EXPECT_TRUE(ini_getValue(&ctx, "paths", "include", value, sizeof(value)));
+    EXPECT_STREQ(value, "c");
+    EXPECT_EQ(ini_getValueCount(&ctx, "paths", "include"), 1u);
+    // The surviving record keeps the position of the first occurrence
+    EXPECT_STREQ(ctx.keyValues[0].key, "include");
+    ini_cleanup(&ctx);
+
+    options.duplicateKeys = INI_DUPLICATE_FIRST_WINS;
+    ASSERT_TRUE(ini_initialize_ex(&ctx, content.c_str(), content.size(), &options));
+    EXPECT_EQ(ctx.keyCount, 2u);
+    EXPECT_TRUE(ini_getValue(&ctx, "paths", "include", value, sizeof(value)));
+    EXPECT_STREQ(value, "a");
+    ini_cleanup(&ctx);
+
+    options.duplicateKeys = INI_DUPLICATE_KEEP_ALL;
+    ASSERT_TRUE(ini_initialize_ex(&ctx, content.c_str(), content.size(), &options));
+    EXPECT_EQ(ctx.keyCount, 4u);
+    EXPECT_TRUE(ini_getValue(&ctx, "paths", "include", value, sizeof(value)));
+    EXPECT_STREQ(value, "c");
+    ASSERT_EQ(ini_getValueCount(&ctx, "paths", foldsCase ? "Include" : "include"), 3u);
+    EXPECT_TRUE(ini_getValueAt(&ctx, "paths", "include", 0, &ref, &length));
+    EXPECT_STREQ(ref, "a");
+    EXPECT_TRUE(ini_getValueAt(&ctx, "paths", "include", 1, &ref, &length));
+    EXPECT_STREQ(ref, "b");
+    EXPECT_TRUE(ini_getValueAt(&ctx, "paths", "include", 2, &ref, &length));
+    EXPECT_STREQ(ref, "c");
+    EXPECT_FALSE(ini_getValueAt(&ctx, "paths", "include", 3, &ref, &length));
+    EXPECT_EQ(ini_getValueCount(&ctx, "paths", "missing"), 0u);
+    EXPECT_EQ(ini_getValueCount(&ctx, "nowhere", "include"), 0u);
+}
+
+TEST_F(IniParserTest, MergesRepeatedSections)
+{
+    // The repeat of [db] differs in case wherever lookups fold it
+    const char *repeat = foldsCase ? "DB" : "db";
+    std::string content = std::string("[db]\n"
+                                      "host=primary\n"
+                                      "[cache]\n"
+                                      "size=10\n") +
+                          "[" + repeat + "]\n"
+                          "port=5432\n"
+                          "host=replica\n"
+                          "[cache]\n";
+    char value[INI_MAX_LINE_LENGTH];
+    ASSERT_TRUE(LoadIniContent(content.c_str()));
+    ASSERT_EQ(ctx.sectionCount, 2u);
+    EXPECT_STREQ(ctx.sections[0].name, "db");
+    EXPECT_EQ(ctx.sections[0].keyCount, 2u);
+    EXPECT_STREQ(ctx.keyValues[ctx.sections[0].firstKey].key, "host");
+    EXPECT_STREQ(ctx.keyValues[ctx.sections[0].firstKey + 1].key, "port");
+    EXPECT_TRUE(ini_getValue(&ctx, "db", "port", value, sizeof(value)));
+    EXPECT_STREQ(value, "5432");
+    EXPECT_TRUE(ini_getValue(&ctx, "db", "host", value, sizeof(value)));
+    EXPECT_STREQ(value, "replica");
+    EXPECT_TRUE(ini_getValue(&ctx, "cache", "size", value, sizeof(value)));
+    EXPECT_STREQ(value, "10");
+    ini_cleanup(&ctx);
+
+    ini_options_t options = {};
+    options.keepDuplicateSections = true;
+    ASSERT_TRUE(ini_initialize_ex(&ctx, content.c_str(), content.size(), &options));
+    ASSERT_EQ(ctx.sectionCount, 4u);
+    EXPECT_STREQ(ctx.sections[2].name, repeat);
+    EXPECT_EQ(ctx.sections[2].keyCount, 2u);
+    // Kept-apart sections resolve to the first block, as before merging existed
+    EXPECT_TRUE(ini_getValue(&ctx, "db", "host", value, sizeof(value)));
+    EXPECT_STREQ(value, "primary");
+    EXPECT_FALSE(ini_hasKey(&ctx, "db", "port"));
+}
+
+TEST_F(IniParserTest, ScanningAcrossVectorBlockBoundaries)
+{
+    // Delimiters and line ends land at every offset of a 16/32/64-byte scanning block. Lines
+    // stay within INI_MAX_LINE_LENGTH, so every one of them is parsed whole.
+    const size_t keys = std::min<size_t>(140, INI_MAX_LINE_LENGTH - 1);
+    auto valueLength = [](size_t len)
+    {
+        return std::min<size_t>(len % 70, INI_MAX_LINE_LENGTH - 2 - len);
+    };
+    std::string content = "[s]\n";
+
+    for(size_t len = 1; len < keys; len++)
+    {
+        content += std::string(len, 'k') + (len % 2 ? "=" : ":") + std::string(valueLength(len), 'v') +
+                   (len % 3 ? "\n" : "\r\n");
+    }
+
+    ASSERT_TRUE(ini_initialize(&ctx, content.c_str(), content.size()));
+    EXPECT_EQ(ctx.keyCount, keys - 1);
+    char value[INI_MAX_LINE_LENGTH];
+
+    for(size_t len = 1; len < keys; len++)
+    {
+        ASSERT_TRUE(ini_getValue(&ctx, "s", std::string(len, 'k').c_str(), value, sizeof(value))) << len;
+        EXPECT_EQ(std::string(valueLength(len), 'v'), value);
+    }
+
+    auto handler = [](ini_eventtype_t type, const char *, const char *key, const char *value, void *userdata)
+    {
+        if(type == INI_EVENT_KEY_VALUE)
+        {
+            auto *pairs = static_cast<std::map<std::string, std::string> *>(userdata);
+            (*pairs)[key] = value;
+        }
+
+        return type != INI_EVENT_ERROR;
+    };
+    std::map<std::string, std::string> pairs;
+    EXPECT_TRUE(ini_parse_stream(content.c_str(), content.size(), handler, &pairs));
+    EXPECT_EQ(pairs.size(), keys - 1);
+    EXPECT_EQ(pairs[std::string(keys - 1, 'k')], std::string(valueLength(keys - 1), 'v'));
+}
+
+TEST_F(IniParserTest, EveryKernelParsesAlike)
+{
+    // Padding, mixed case and long names exercise the whitespace and case-folding kernels
+    std::string content = "[ Mixed Case Section Name For Folding ]\n";
+    std::vector<size_t> lengths;
+
+    for(size_t len = 1; len < 80; len++)
+    {
+        std::string line = std::string(len % 37, ' ') + "Key" + std::string(len, 'X') + std::string(len % 5, '\t') +
+                           "=" + std::string(len % 19, ' ') + std::string(len % 50, 'v') + std::string(len % 23, ' ');
+
+        // Only lines that fit INI_MAX_LINE_LENGTH whole are used
+        if(line.size() < INI_MAX_LINE_LENGTH)
+        {
+            content += line + "\n";
+            lengths.push_back(len);
+        }
+    }
+
+    const char *original = ini_getKernel();
+    const char *names[] = { "scalar", "swar", "sse2", "avx2", "neon" };
+    size_t tested = 0;
+
+    for(const char *name : names)
+    {
+        if(!ini_setKernel(name))
+        {
+            continue;
+        }
+
+        tested++;
+        EXPECT_STREQ(ini_getKernel(), name);
+        ASSERT_TRUE(ini_initialize(&ctx, content.c_str(), content.size())) << name;
+        EXPECT_EQ(ctx.keyCount, lengths.size()) << name;
+        EXPECT_TRUE(ini_hasSection(&ctx, foldsCase ? "mixed case section name for folding" :
+                                   "Mixed Case Section Name For Folding")) << name;
+        EXPECT_FALSE(ini_hasSection(&ctx, "Mixed Case Section Name For Foldin")) << name;
+
+        for(size_t len : lengths)
+        {
+            const char *value;
+            size_t length;
+            std::string key = foldsCase ? "key" + std::string(len, 'x') : "Key" + std::string(len, 'X');
+            ASSERT_TRUE(ini_getValueRef(&ctx, foldsCase ? "MIXED CASE SECTION NAME FOR FOLDING" :
+                                        "Mixed Case Section Name For Folding", key.c_str(),
+                                        &value, &length)) << name << " " << len;
+            EXPECT_EQ(std::string(value, length), std::string(len % 50, 'v')) << name << " " << len;
+        }
+
+        ini_cleanup(&ctx);
+    }
+
+    EXPECT_GE(tested, 1u);
+    EXPECT_FALSE(ini_setKernel("no-such-kernel"));
+    EXPECT_TRUE(ini_setKernel(NULL));
+    EXPECT_STREQ(ini_getKernel(), original);
+}
+
+TEST_F(IniParserTest, StreamTokensMatchContext)
+{
+    const char *content =
+        "  [  spaced section  ]  \n"
+        "\tkey one \t=  value with  inner  spaces \t\r\n"
+        "k2:v2\n"
+        "   ; indented comment\n"
+        "broken line\n"
+        "[s2]\n"
+        "empty =\n";
+    struct Events
+    {
+        std::vector<std::string> log;
+    } events;
+    auto handler = [](ini_eventtype_t type, const char *section, const char *key, const char *value, void *userdata)
+    {
+        auto *events = static_cast<Events *>(userdata);
+        events->log.push_back(std::to_string(type) + "|" + (section ? section : "") + "|" +
+                              (key ? key : "") + "|" + (value ? value : ""));
+        return true;
+    };
+    ASSERT_TRUE(ini_parse_stream(content, strlen(content), handler, &events));
+    std::vector<std::string> expected =
+    {
+        std::to_string(INI_EVENT_SECTION) + "|spaced section||",
+        std::to_string(INI_EVENT_KEY_VALUE) + "|spaced section|key one|value with  inner  spaces",
+        std::to_string(INI_EVENT_KEY_VALUE) + "|spaced section|k2|v2",
+        std::to_string(INI_EVENT_COMMENT) + "|||   ; indented comment",
+        std::to_string(INI_EVENT_ERROR) + "|||broken line",
+        std::to_string(INI_EVENT_SECTION) + "|s2||",
+        std::to_string(INI_EVENT_KEY_VALUE) + "|s2|empty|",
+    };
+    EXPECT_EQ(events.log, expected);
+
+    ASSERT_TRUE(ini_initialize(&ctx, content, strlen(content)));
+    char value[INI_MAX_LINE_LENGTH];
+    ASSERT_TRUE(ini_getValue(&ctx, "spaced section", "key one", value, sizeof(value)));
+    EXPECT_STREQ(value, "value with  inner  spaces");
+}
+
+TEST_F(IniParserTest, ClassificationIgnoresLocale)
+{
+    // Only ASCII whitespace is trimmed; high bytes such as NBSP (0xA0) or NEL (0x85) belong to
+    // the token whatever locale the host selected
+    std::setlocale(LC_ALL, "");
+    const char *content = "[\xA0s\xA0]\n\x85key\x85 = \xA0value\xA0\n\vk2\f=\tv2\t\n";
+    ASSERT_TRUE(ini_initialize(&ctx, content, strlen(content)));
+    std::setlocale(LC_ALL, "C");
+    char value[INI_MAX_LINE_LENGTH];
+    ASSERT_TRUE(ini_getValue(&ctx, "\xA0s\xA0", "\x85key\x85", value, sizeof(value)));
+    EXPECT_STREQ(value, "\xA0value\xA0");
+    ASSERT_TRUE(ini_getValue(&ctx, "\xA0s\xA0", "k2", value, sizeof(value)));
+    EXPECT_STREQ(value, "v2");
+}
+
+// Random lines dense in delimiters, brackets, mixed case and whitespace
+static std::string MakeRandomIni(unsigned seed, size_t lines, size_t maxLineLength)
+{
+    const char alphabet[] = "aAzZ09_ \t\v\f=:[];#\xA0\x85";
+    std::string content;
+
+    for(size_t line = 0; line < lines; line++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        size_t len = (seed >> 16) % maxLineLength;
+
+        for(size_t i = 0; i < len; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            content += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+        }
+
+        content += line % 7 ? "\n" : "\r\n";
+    }
+
+    return content;
+}
+
+// Appends one line per event to the std::string passed as userdata
+static bool LogEvent(ini_eventtype_t type, const char *section, const char *key, const char *value, void *userdata)
+{
+    auto *log = static_cast<std::string *>(userdata);
+    *log += std::to_string(type) + "|" + (section ? section : "") + "|" + (key ? key : "") + "|" +
+            (value ? value : "") + "\n";
+    return true;
+}
+
+// Formats a span event like LogEvent, which only sees a section for sections and keys
+static std::string DescribeEvent(const ini_event_t &event)
+{
+    bool inSection = event.type == INI_EVENT_SECTION || event.type == INI_EVENT_KEY_VALUE;
+    return std::to_string(event.type) + "|" +
+           (inSection ? std::string(event.section.ptr, event.section.len) : "") + "|" +
+           std::string(event.key.ptr ? event.key.ptr : "", event.key.len) + "|" +
+           std::string(event.value.ptr ? event.value.ptr : "", event.value.len) + "\n";
+}
+
+static std::string StreamEvents(const std::string &content, const ini_options_t *options)
+{
+    std::string log;
+    EXPECT_TRUE(ini_parse_stream_ex(content.c_str(), content.size(), LogEvent, &log, options));
+    return log;
+}
+
+TEST_F(IniParserTest, KernelsAgreeOnRandomInput)
+{
+    // Every kernel must produce the event sequence of the scalar reference
+    std::string content = MakeRandomIni(12345, 3000, 90);
+    ASSERT_TRUE(ini_setKernel("scalar"));
+    std::string reference = StreamEvents(content, NULL);
+
+    for(const char *name : { "swar", "sse2", "avx2", "neon" })
+    {
+        if(!ini_setKernel(name))
+        {
+            continue;
+        }
+
+        EXPECT_EQ(StreamEvents(content, NULL), reference) << name;
+    }
+
+    ini_setKernel(NULL);
+}
+
+TEST_F(IniParserTest, StructuralEngineMatchesLinear)
+{
+    // Spans several index windows, with lines cut by window ends, lines longer than the line
+    // cap and one line longer than a whole window
+    std::string content = MakeRandomIni(777, 40000, 300);
+    std::string longLine = "k=" + std::string(INI_STRUCTURAL_WINDOW + 1000, 'v');
+    content.insert(content.find('\n', content.size() / 2) + 1, "[long]\n" + longLine + "\n[tail]\nx = 1\n");
+    content += "[last]\nno newline = at end";
+    ini_options_t linear = {};
+    ini_options_t structural = {};
+    linear.engine = INI_ENGINE_LINEAR;
+    structural.engine = INI_ENGINE_STRUCTURAL;
+
+    for(const char *name : { "scalar", "swar", "sse2", "avx2", "neon" })
+    {
+        if(!ini_setKernel(name))
+        {
+            continue;
+        }
+
+        EXPECT_EQ(StreamEvents(content, &structural), StreamEvents(content, &linear)) << name;
+    }
+
+    ini_setKernel(NULL);
+    ini_context_t other;
+    ASSERT_TRUE(ini_initialize_ex(&ctx, content.c_str(), content.size(), &linear));
+    ASSERT_TRUE(ini_initialize_ex(&other, content.c_str(), content.size(), &structural));
+    ASSERT_EQ(ctx.sectionCount, other.sectionCount);
+    ASSERT_EQ(ctx.keyCount, other.keyCount);
+
+    for(size_t k = 0; k < ctx.keyCount; k++)
+    {
+        EXPECT_STREQ(ctx.keyValues[k].key, other.keyValues[k].key);
+        EXPECT_STREQ(ctx.keyValues[k].value, other.keyValues[k].value);
+    }
+
+    const char *value;
+    size_t length;
+    ASSERT_TRUE(ini_getValueRef(&other, "long", "k", &value, &length));
+    EXPECT_EQ(length, INI_MAX_LINE_LENGTH - 3u);
+    EXPECT_TRUE(ini_getValueRef(&other, "tail", "x", &value, &length));
+    EXPECT_TRUE(ini_getValueRef(&other, "last", "no newline", &value, &length));
+    EXPECT_STREQ(value, "at end");
+    ini_cleanup(&other);
+
+    std::string buffer = content;
+    ASSERT_TRUE(ini_initialize_insitu_ex(&other, &buffer[0], buffer.size(), &structural));
+    EXPECT_EQ(ctx.keyCount, other.keyCount);
+    ini_cleanup(&other);
+}
+
+TEST_F(IniParserTest, ParallelParsingMatchesSequential)
+{
+    // Several chunks per parse and several rounds per stream; most chunks start mid-section
+    std::string content = MakeRandomIni(4242, 60000, 300);
+    ini_options_t sequential = {};
+    sequential.duplicateKeys = INI_DUPLICATE_KEEP_ALL;
+    sequential.keepDuplicateSections = true;
+    sequential.threads = 1;
+    std::string reference = StreamEvents(content, &sequential);
+
+    for(ini_engine_t engine : { INI_ENGINE_LINEAR, INI_ENGINE_STRUCTURAL })
+    {
+        for(unsigned threads : { 2u, 3u, 8u })
+        {
+            ini_options_t parallel = sequential;
+            parallel.engine = engine;
+            parallel.threads = threads;
+            EXPECT_EQ(StreamEvents(content, &parallel), reference) << engine << " " << threads;
+
+            ini_context_t other;
+            ASSERT_TRUE(ini_initialize_ex(&ctx, content.c_str(), content.size(), &sequential));
+            ASSERT_TRUE(ini_initialize_ex(&other, content.c_str(), content.size(), &parallel));
+            ASSERT_EQ(ctx.sectionCount, other.sectionCount);
+            ASSERT_EQ(ctx.keyCount, other.keyCount);
+
+            for(size_t s = 0; s < ctx.sectionCount; s++)
+            {
+                EXPECT_STREQ(ctx.sections[s].name, other.sections[s].name);
+                EXPECT_EQ(ctx.sections[s].firstKey, other.sections[s].firstKey);
+                EXPECT_EQ(ctx.sections[s].keyCount, other.sections[s].keyCount);
+            }
+
+            for(size_t k = 0; k < ctx.keyCount; k++)
+            {
+                EXPECT_STREQ(ctx.keyValues[k].key, other.keyValues[k].key);
+                EXPECT_STREQ(ctx.keyValues[k].value, other.keyValues[k].value);
+            }
+
+            ini_cleanup(&other);
+            ini_cleanup(&ctx);
+        }
+    }
+
+    // Merged sections and in-situ buffers go through the same fragment merge
+    ini_options_t merged = {};
+    merged.threads = 4;
+    std::string buffer = content;
+    ini_context_t other;
+    ASSERT_TRUE(ini_initialize(&ctx, content.c_str(), content.size()));
+    ASSERT_TRUE(ini_initialize_insitu_ex(&other, &buffer[0], buffer.size(), &merged));
+    EXPECT_EQ(ctx.sectionCount, other.sectionCount);
+    EXPECT_EQ(ctx.keyCount, other.keyCount);
+    ini_cleanup(&other);
+    ini_cleanup(&ctx);
+
+    // Chunks that hold nothing but headers leave fragments without keys
+    std::string headers;
+
+    for(size_t s = 0; headers.size() < 3 << 20; s++)
+    {
+        headers += "[h" + std::to_string(s) + "]\n";
+    }
+
+    headers += "key=value\n";
+    ASSERT_TRUE(ini_initialize(&ctx, headers.c_str(), headers.size()));
+    ASSERT_TRUE(ini_initialize_ex(&other, headers.c_str(), headers.size(), &merged));
+    EXPECT_EQ(ctx.sectionCount, other.sectionCount);
+    EXPECT_EQ(other.keyCount, 1u);
+    ini_cleanup(&other);
+
+    // A handler that stops the parse stops every round
+    auto stopAtTen = [](ini_eventtype_t, const char *, const char *, const char *, void *userdata)
+    {
+        return ++*static_cast<size_t *>(userdata) < 10;
+    };
+    size_t events = 0;
+    EXPECT_FALSE(ini_parse_stream_ex(content.c_str(), content.size(), stopAtTen, &events, &merged));
+    EXPECT_EQ(events, 10u);
+}
+
+TEST_F(IniParserTest, LazySectionsLoadOnFirstLookup)
+{
+    const char *ini =
+        "top = before any section\n"
+        "[a]\n"
+        "x = 1\n"
+        "  [b]  \n"
+        "y = 2\n"
+        "link = [not a header]\n"
+        "[a]\n"
+        "x = 3\n"
+        "z = 4\n"
+        "[c]";
+    ini_options_t options = {};
+    options.lazy = true;
+
+    ASSERT_TRUE(ini_initialize_ex(&ctx, ini, strlen(ini), &options));
+    EXPECT_EQ(ctx.sectionCount, 3u);
+    EXPECT_EQ(ctx.keyCount, 0u);
+    EXPECT_TRUE(ini_hasSection(&ctx, foldsCase ? "B" : "b"));
+    EXPECT_EQ(ctx.keyCount, 0u);
+
+    // Both [a] blocks are parsed together, as if merged up front
+    const char *value;
+    size_t length;
+    ASSERT_TRUE(ini_getValueRef(&ctx, "a", "x", &value, &length));
+    EXPECT_STREQ(value, "3");
+    EXPECT_EQ(ctx.keyCount, 2u);
+    EXPECT_TRUE(ini_hasKey(&ctx, "a", "z"));
+    EXPECT_EQ(ctx.keyCount, 2u);
+
+    ini_handle_t handle;
+    ASSERT_TRUE(ini_resolve(&ctx, "b", "link", &handle));
+    ASSERT_TRUE(ini_getValueByHandle(&ctx, handle, &value, &length));
+    EXPECT_STREQ(value, "[not a header]");
+    EXPECT_FALSE(ini_hasKey(&ctx, "c", "x"));
+    EXPECT_FALSE(ini_hasKey(&ctx, "missing", "x"));
+    EXPECT_EQ(ctx.keyCount, 4u);
+    ini_cleanup(&ctx);
+
+    // Without a header there is nothing to defer
+    EXPECT_FALSE(ini_initialize_ex(&ctx, "key = value\n", 12, &options));
+}
+
+TEST_F(IniParserTest, LazyLoadFailuresLoseNoKeys)
+{
+    std::string ini = "[big]\n";
+
+    for(int k = 0; k < 100; k++)
+    {
+        ini += "k" + std::to_string(k) + " = " + std::to_string(k) + "\n";
+    }
+
+    ini += "[other]\nx = 1\n";
+    ini_options_t options = {};
+    options.lazy = true;
+
+    for(bool insitu : { false, true })
+    {
+        long allowed = 0;
+
+        // Fails the load at every allocation it makes in turn, until it gets through
+        for(bool loaded = false; !loaded; allowed++)
+        {
+            std::string buffer = ini;
+            ASSERT_TRUE(insitu ? ini_initialize_insitu_ex(&ctx, &buffer[0], buffer.size(), &options) :
+                        ini_initialize_ex(&ctx, ini.c_str(), ini.size(), &options));
+            ini_test_failAllocationsAfter(allowed);
+            loaded = ini_hasKey(&ctx, "big", "k99");
+            ini_test_failAllocationsAfter(-1);
+            const char *value = nullptr;
+            size_t length = 0;
+
+            if(!loaded)
+            {
+                // A copying load is simply retried; an in-situ one has cut up part of the
+                // section already and keeps failing rather than answering from broken text
+                for(int k = 0; k < 100; k++)
+                {
+                    std::string key = "k" + std::to_string(k);
+                    ASSERT_EQ(ini_getValueRef(&ctx, "big", key.c_str(), &value, &length), !insitu)
+                            << allowed << " " << key;
+                    EXPECT_TRUE(insitu || std::to_string(k) == value);
+                }
+            }
+
+            ASSERT_TRUE(ini_getValueRef(&ctx, "other", "x", &value, &length));
+            EXPECT_STREQ(value, "1");
+            ini_cleanup(&ctx);
+        }
+
+        EXPECT_GT(allowed, 2) << insitu;
+    }
+}
+
+TEST_F(IniParserTest, LazyContextMatchesEager)
+{
+    std::string content = MakeRandomIni(2024, 6000, 60);
+    content += "[last]\nno newline = at end";
+
+    for(ini_duplicate_t duplicates : { INI_DUPLICATE_LAST_WINS, INI_DUPLICATE_FIRST_WINS, INI_DUPLICATE_KEEP_ALL })
+    {
+        for(bool keepSections : { false, true })
+        {
+            ini_options_t eager = {};
+            eager.duplicateKeys = duplicates;
+            eager.keepDuplicateSections = keepSections;
+            ini_options_t lazy = eager;
+            lazy.engine = INI_ENGINE_STRUCTURAL;
+            lazy.lazy = true;
+            std::string buffer = content;
+            ini_context_t other;
+            ASSERT_TRUE(ini_initialize_ex(&ctx, content.c_str(), content.size(), &eager));
+            ASSERT_TRUE(ini_initialize_insitu_ex(&other, &buffer[0], buffer.size(), &lazy));
+            ASSERT_EQ(ctx.sectionCount, other.sectionCount);
+
+            // Sections are visited back to front so the key table grows while sections load
+            for(size_t s = ctx.sectionCount; s-- > 0;)
+            {
+                const ini_section_t *section = &ctx.sections[s];
+                EXPECT_STREQ(section->name, other.sections[s].name);
+
+                for(uint32_t k = section->firstKey; k < section->firstKey + section->keyCount; k++)
+                {
+                    const char *key = ctx.keyValues[k].key;
+                    size_t count = ini_getValueCount(&ctx, section->name, key);
+                    ASSERT_EQ(ini_getValueCount(&other, section->name, key), count) << section->name << "/" << key;
+
+                    for(size_t n = 0; n < count; n++)
+                    {
+                        const char *expected;
+                        const char *actual;
+                        size_t length;
+                        ASSERT_TRUE(ini_getValueAt(&ctx, section->name, key, n, &expected, &length));
+                        ASSERT_TRUE(ini_getValueAt(&other, section->name, key, n, &actual, &length));
+                        EXPECT_STREQ(actual, expected);
+                    }
+                }
+            }
+
+            // Kept duplicate sections are never reached by a lookup, so they stay unparsed
+            if(!keepSections)
+            {
+                EXPECT_EQ(ctx.keyCount, other.keyCount);
+            }
+
+            ini_cleanup(&other);
+
+            // Freezing loads whatever is still pending
+            ini_frozen_t frozen;
+            ASSERT_TRUE(ini_initialize_ex(&other, content.c_str(), content.size(), &lazy));
+            ASSERT_TRUE(ini_freeze(&other, &frozen));
+            EXPECT_EQ(ctx.keyCount, other.keyCount);
+            EXPECT_TRUE(ini_frozen_hasKey(&frozen, "last", "no newline"));
+            ini_frozen_cleanup(&frozen);
+            ini_cleanup(&other);
+            ini_cleanup(&ctx);
+        }
+    }
+}
+
+TEST_F(IniParserTest, PushParserMatchesStream)
+{
+    // Long lines exceed the line cap, and CRLF pairs get split between chunks
+    std::string content = MakeRandomIni(99, 4000, 600) + "[end]\nlast = no newline";
+    std::string reference = StreamEvents(content, NULL);
+
+    for(size_t chunk : { (size_t)1, (size_t)2, (size_t)7, (size_t)255, (size_t)4096, content.size() })
+    {
+        std::string log;
+        ini_push_t parser;
+        ASSERT_TRUE(ini_push_init(&parser, LogEvent, &log));
+
+        for(size_t pos = 0; pos < content.size(); pos += chunk)
+        {
+            ASSERT_TRUE(ini_push_feed(&parser, content.data() + pos, std::min(chunk, content.size() - pos)));
+        }
+
+        ASSERT_TRUE(ini_push_feed(&parser, NULL, 0));
+        EXPECT_TRUE(ini_push_finish(&parser));
+        EXPECT_EQ(log, reference) << chunk;
+    }
+
+    // A handler that stops the parse fails this and every later call
+    auto stop = [](ini_eventtype_t type, const char *, const char *, const char *, void *)
+    {
+        return type != INI_EVENT_KEY_VALUE;
+    };
+    ini_push_t parser;
+    ASSERT_TRUE(ini_push_init(&parser, stop, NULL));
+    EXPECT_TRUE(ini_push_feed(&parser, "[a]\nkey", 7));
+    EXPECT_FALSE(ini_push_feed(&parser, " = value\n", 9));
+    EXPECT_FALSE(ini_push_feed(&parser, "\n", 1));
+    EXPECT_FALSE(ini_push_finish(&parser));
+}
+
+TEST_F(IniParserTest, ReaderMatchesStream)
+{
+    std::string content = MakeRandomIni(31337, 4000, 400) + "[end]\nlast = no newline";
+    std::string log;
+    ini_reader_t reader;
+    ini_event_t event;
+    ASSERT_TRUE(ini_reader_init(&reader, content.data(), content.size()));
+
+    while(ini_reader_next(&reader, &event))
+    {
+        log += DescribeEvent(event);
+    }
+
+    EXPECT_EQ(log, StreamEvents(content, NULL));
+    EXPECT_FALSE(ini_reader_next(&reader, &event));
+
+    // Spans point into the input instead of copies
+    const char *ini = "; note\n[db]\nhost = localhost\n";
+    ASSERT_TRUE(ini_reader_init(&reader, ini, strlen(ini)));
+    ASSERT_TRUE(ini_reader_next(&reader, &event));
+    EXPECT_EQ(event.type, INI_EVENT_COMMENT);
+    EXPECT_EQ(event.section.len, 0u);
+    ASSERT_TRUE(ini_reader_next(&reader, &event));
+    EXPECT_EQ(event.type, INI_EVENT_SECTION);
+    ASSERT_TRUE(ini_reader_next(&reader, &event));
+    EXPECT_EQ(event.type, INI_EVENT_KEY_VALUE);
+    EXPECT_EQ(event.section.ptr, ini + 8);
+    EXPECT_EQ(event.section.len, 2u);
+    EXPECT_EQ(event.value.ptr, ini + 19);
+    EXPECT_EQ(std::string(event.value.ptr, event.value.len), "localhost");
+    EXPECT_FALSE(ini_reader_next(&reader, &event));
+}
+
+TEST_F(IniParserTest, SpanStreamMatchesStream)
+{
+    std::string content = MakeRandomIni(8080, 8000, 600) + "[end]\nlast = no newline";
+    struct Log
+    {
+        const std::string *content;
+        std::string text;
+    };
+    auto handler = [](const ini_event_t *event, void *userdata)
+    {
+        auto *log = static_cast<Log *>(userdata);
+        const char *begin = log->content->data();
+        const char *end = begin + log->content->size();
+
+        for(const ini_span_t *span : { &event->section, &event->key, &event->value })
+        {
+            EXPECT_TRUE(span->len == 0 || (span->ptr >= begin && span->ptr + span->len <= end));
+        }
+
+        log->text += DescribeEvent(*event);
+        return true;
+    };
+    std::string reference = StreamEvents(content, NULL);
+
+    for(ini_engine_t engine : { INI_ENGINE_LINEAR, INI_ENGINE_STRUCTURAL })
+    {
+        for(unsigned threads : { 0u, 3u })
+        {
+            ini_options_t options = {};
+            options.engine = engine;
+            options.threads = threads;
+            Log log = { &content, "" };
+            EXPECT_TRUE(ini_parse_stream_spans(content.data(), content.size(), handler, &log, &options));
+            EXPECT_EQ(log.text, reference) << engine << " " << threads;
+        }
+    }
+
+    auto stop = [](const ini_event_t *event, void *)
+    {
+        return event->type != INI_EVENT_KEY_VALUE;
+    };
+    EXPECT_FALSE(ini_parse_stream_spans("[a]\nk = v\n", 10, stop, NULL, NULL));
+    EXPECT_FALSE(ini_parse_stream_spans(NULL, 0, stop, NULL, NULL));
+}
+
+TEST_F(IniParserTest, BatchedEventsMatchSpans)
+{
+    std::string content = MakeRandomIni(4711, 12000, 300) + "\r\r\n\n[end]\nlast = no newline";
+
+    // Line number of every byte: "\r\n", a lone '\r' and a lone '\n' each end one line
+    std::vector<size_t> lineAt(content.size() + 1, 1);
+
+    for(size_t i = 0; i < content.size(); i++)
+    {
+        bool lineBreak = content[i] == '\n' || (content[i] == '\r' && content[i + 1] != '\n');
+        lineAt[i + 1] = lineAt[i] + lineBreak;
+    }
+
+    struct Batches
+    {
+        std::vector<ini_event_t> events;
+        size_t calls;
+    };
+    auto collect = [](const ini_event_t *events, size_t count, void *userdata)
+    {
+        auto *batches = static_cast<Batches *>(userdata);
+        batches->events.insert(batches->events.end(), events, events + count);
+        batches->calls++;
+        return true;
+    };
+    Batches reference = { {}, 0 };
+    ini_event_t one;
+    ASSERT_TRUE(ini_parse_stream_batch(content.data(), content.size(), &one, 1, collect, &reference, NULL));
+    ASSERT_EQ(reference.calls, reference.events.size());
+    uint32_t sections = 0;
+
+    for(const ini_event_t &event : reference.events)
+    {
+        const ini_span_t &anchor = event.type == INI_EVENT_SECTION ? event.section :
+                                   event.type == INI_EVENT_KEY_VALUE ? event.key : event.value;
+        EXPECT_EQ(event.line, lineAt[anchor.ptr - content.data()]);
+        sections += event.type == INI_EVENT_SECTION;
+        EXPECT_EQ(event.sectionId, sections);
+    }
+
+    EXPECT_EQ(reference.events.back().line, lineAt.back());
+
+    for(ini_engine_t engine : { INI_ENGINE_LINEAR, INI_ENGINE_STRUCTURAL })
+    {
+        for(unsigned threads : { 0u, 3u })
+        {
+            ini_options_t options = {};
+            options.engine = engine;
+            options.threads = threads;
+            ini_event_t events[100];
+            Batches batches = { {}, 0 };
+            ASSERT_TRUE(ini_parse_stream_batch(content.data(), content.size(), events, 100, collect, &batches,
+                                               &options));
+            EXPECT_EQ(batches.calls, (reference.events.size() + 99) / 100);
+            ASSERT_EQ(batches.events.size(), reference.events.size());
+
+            for(size_t i = 0; i < reference.events.size(); i++)
+            {
+                const ini_event_t &a = batches.events[i];
+                const ini_event_t &b = reference.events[i];
+                ASSERT_TRUE(a.type == b.type && a.section.ptr == b.section.ptr && a.section.len == b.section.len &&
+                            a.key.ptr == b.key.ptr && a.key.len == b.key.len && a.value.ptr == b.value.ptr &&
+                            a.value.len == b.value.len && a.sectionId == b.sectionId && a.line == b.line)
+                        << engine << " " << threads << " event " << i;
+            }
+        }
+    }
+
+    // Span handler and reader describe the same events
+    ini_reader_t reader;
+    ini_event_t event;
+    size_t n = 0;
+    ASSERT_TRUE(ini_reader_init(&reader, content.data(), content.size()));
+
+    while(ini_reader_next(&reader, &event) && n < reference.events.size())
+    {
+        EXPECT_EQ(event.line, reference.events[n].line);
+        EXPECT_EQ(event.sectionId, reference.events[n++].sectionId);
+    }
+
+    EXPECT_EQ(n, reference.events.size());
+
+    auto stop = [](const ini_event_t *, size_t, void *)
+    {
+        return false;
+    };
+    EXPECT_FALSE(ini_parse_stream_batch("[a]\nk = v\n", 10, &one, 1, stop, NULL, NULL));
+    EXPECT_FALSE(ini_parse_stream_batch("[a]\nk = v\n", 10, &one, 0, stop, NULL, NULL));
+}
+
+TEST_F(IniParserTest, StreamSkipsMaskedEvents)
+{
+    std::string content = MakeRandomIni(2718, 12000, 300);
+    std::string all = StreamEvents(content, NULL);
+    const unsigned masks[] =
+    {
+        INI_EVENT_MASK(INI_EVENT_COMMENT),
+        INI_EVENT_MASK(INI_EVENT_COMMENT) | INI_EVENT_MASK(INI_EVENT_ERROR),
+        INI_EVENT_MASK(INI_EVENT_KEY_VALUE) | INI_EVENT_MASK(INI_EVENT_SECTION)
+    };
+
+    for(unsigned mask : masks)
+    {
+        // Everything else is delivered unchanged; sections cannot be skipped
+        std::string expected;
+
+        for(size_t pos = 0, next; pos < all.size(); pos = next)
+        {
+            next = all.find('\n', pos) + 1;
+            int type = all[pos] - '0';
+
+            if(type == INI_EVENT_SECTION || !(mask & INI_EVENT_MASK(type)))
+            {
+                expected.append(all, pos, next - pos);
+            }
+        }
+
+        for(unsigned threads : { 0u, 3u })
+        {
+            ini_options_t options = {};
+            options.engine = INI_ENGINE_STRUCTURAL;
+            options.threads = threads;
+            options.skipEvents = mask;
+            EXPECT_EQ(StreamEvents(content, &options), expected) << mask << " " << threads;
+        }
+    }
+
+    // Span events keep their section ids and line numbers
+    auto check = [](const ini_event_t *events, size_t count, void *)
+    {
+        EXPECT_EQ(count, 3u);
+
+        for(size_t i = 0; i < count; i++)
+        {
+            EXPECT_EQ(events[i].type, i ? INI_EVENT_KEY_VALUE : INI_EVENT_SECTION);
+            EXPECT_EQ(events[i].sectionId, 1u);
+            EXPECT_EQ(events[i].line, i + 2);
+        }
+
+        return true;
+    };
+    const char *ini = "; vendor header\n[a]\nx = 1\ny = 2\n; trailing\n[unclosed\n";
+    ini_options_t options = {};
+    options.skipEvents = INI_EVENT_MASK(INI_EVENT_COMMENT) | INI_EVENT_MASK(INI_EVENT_ERROR);
+    ini_event_t events[8];
+    EXPECT_TRUE(ini_parse_stream_batch(ini, strlen(ini), events, 8, check, NULL, &options));
+}
+
+// Compares names the way lookups do, folding ASCII case only where the library does
+static bool NamesMatch(const std::string &a, const std::string &b)
+{
+    auto fold = [](char c)
+    {
+        return foldsCase && c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    };
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [&](char x, char y)
+    {
+        return fold(x) == fold(y);
+    });
+}
+
+TEST_F(IniParserTest, SectionFilterSkipsUnwantedSections)
+{
+    std::string content = "before = any header\n";
+
+    for(unsigned i = 0; i < 120; i++)
+    {
+        content += "  [sec_" + std::to_string(i) + "]" + (i % 3 ? "\n" : "\r") + MakeRandomIni(i, 150, 200);
+    }
+
+    const char *wanted[] = { "SEC_3", "sec_50", "a", "sec_119" };
+    auto collect = [](const ini_event_t *events, size_t count, void *userdata)
+    {
+        auto *all = static_cast<std::vector<ini_event_t> *>(userdata);
+        all->insert(all->end(), events, events + count);
+        return true;
+    };
+
+    // Expected: the unfiltered events of every section whose name is wanted
+    std::vector<ini_event_t> all;
+    ini_event_t events[64];
+    ASSERT_TRUE(ini_parse_stream_batch(content.data(), content.size(), events, 64, collect, &all, NULL));
+    std::vector<bool> wantedIds(1, false);
+    std::vector<ini_event_t> expected;
+    std::string expectedLog;
+
+    for(const ini_event_t &event : all)
+    {
+        if(event.type == INI_EVENT_SECTION)
+        {
+            std::string name(event.section.ptr, event.section.len);
+            wantedIds.push_back(std::any_of(std::begin(wanted), std::end(wanted), [&](const char *w)
+            {
+                return NamesMatch(w, name);
+            }));
+        }
+
+        if(wantedIds[event.sectionId])
+        {
+            expected.push_back(event);
+            expectedLog += DescribeEvent(event);
+        }
+    }
+
+    ASSERT_GT(expected.size(), 200u);
+
+    for(ini_engine_t engine : { INI_ENGINE_LINEAR, INI_ENGINE_STRUCTURAL })
+    {
+        for(unsigned threads : { 0u, 3u })
+        {
+            ini_options_t options = {};
+            options.engine = engine;
+            options.threads = threads;
+            options.sectionFilter = wanted;
+            options.sectionFilterCount = 4;
+            std::vector<ini_event_t> filtered;
+            ASSERT_TRUE(ini_parse_stream_batch(content.data(), content.size(), events, 64, collect, &filtered,
+                                               &options));
+            ASSERT_EQ(filtered.size(), expected.size()) << engine << " " << threads;
+
+            for(size_t i = 0; i < expected.size(); i++)
+            {
+                ASSERT_EQ(DescribeEvent(filtered[i]), DescribeEvent(expected[i])) << engine << " " << threads << " event " << i;
+                ASSERT_EQ(filtered[i].sectionId, expected[i].sectionId);
+                ASSERT_EQ(filtered[i].line, expected[i].line);
+            }
+
+            EXPECT_EQ(StreamEvents(content, &options), expectedLog) << engine << " " << threads;
+        }
+    }
+}
+
 int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);